@@ -23,6 +23,9 @@ menus = {
     --[[
     -- non-boolean options:
     --     "simCmd.historySize" [int]
+    --     "simCmd.historyWriteDelay" [int]
+    --     "simCmd.completionCacheMaxAge" [int]
+    --     "simCmd.headlessCompletionTimeout" [int]
     --     "simCmd.arrayMaxItemsDisplayed" [int]
     --     "simCmd.stringLongLimit" [int]
     --     "simCmd.floatPrecision" [int]
@@ -100,6 +103,13 @@ menus = {
         checked = true,
         propertyName = 'customData.simCmd.historyRemoveDups',
     },
+    {
+        label = 'History: keep in a file (takes effect on restart)',
+        enabled = true,
+        checkable = true,
+        checked = false,
+        propertyName = 'customData.simCmd.historyFile',
+    },
     {
         label = 'History: show matching entries (select with UP)',
         enabled = true,
@@ -107,6 +117,13 @@ menus = {
         checked = false,
         propertyName = 'customData.simCmd.showMatchingHistory',
     },
+    {
+        label = 'History: rank matching entries by frecency',
+        enabled = true,
+        checkable = true,
+        checked = false,
+        propertyName = 'customData.simCmd.historyRankByFrecency',
+    },
     {
         label = 'Set convenience vars',
         enabled = true,
@@ -121,6 +138,27 @@ menus = {
         checked = true,
         propertyName = 'customData.simCmd.autoAcceptCommonCompletionPrefix',
     },
+    {
+        label = 'Fuzzy completion (e.g. sim.gop -> sim.getObjectPosition)',
+        enabled = true,
+        checkable = true,
+        checked = false,
+        propertyName = 'customData.simCmd.fuzzyCompletion',
+    },
+    {
+        label = 'Show completions in a popup list',
+        enabled = true,
+        checkable = true,
+        checked = false,
+        propertyName = 'customData.simCmd.completionPopup',
+    },
+    {
+        label = 'Interruptible execution (Ctrl+C, Lua only)',
+        enabled = true,
+        checkable = true,
+        checked = false,
+        propertyName = 'customData.simCmd.interruptibleExec',
+    },
     {
         label = 'Show full stack traceback',
         enabled = true,
@@ -0,0 +1,56 @@
+// Measures the cost of appending to a HistoryList as it grows to 100k
+// entries, with and without duplicates removal (i.e. what History::append
+// does with customData.simCmd.historyRemoveDups), to check it stays flat.
+//
+// Build with -DBUILD_BENCHMARKS=ON.
+
+#include "HistoryList.h"
+#include <cstdio>
+#include <random>
+#include <QElapsedTimer>
+
+static const int maxEntries = 100000;
+static const int blockSize = 10000;
+
+static QString command(int i)
+{
+    return QString("sim.setObjectPosition(sim.getObject('/robot%1/link'), -1, {%1, 0, 0.5})").arg(i);
+}
+
+static void appendOne(HistoryList &list, const QString &cmd, bool removeDups, double time)
+{
+    if(!removeDups || !list.moveToEnd(cmd))
+        list.append(cmd);
+    list.addUse(list.end() - 1, time);
+    list.compact();
+}
+
+int main()
+{
+    HistoryList list;
+    list.setPrefixIndexEnabled(true);
+    list.setSearchIndexEnabled(true);
+    std::mt19937 rng(1);
+    double time = 1.7e9;
+
+    std::printf("%10s %16s %16s\n", "entries", "append [ns]", "moveToEnd [ns]");
+    for(int n = 0; n < maxEntries; n += blockSize)
+    {
+        // new (unique) commands
+        QElapsedTimer timer;
+        timer.start();
+        for(int i = n; i < n + blockSize; i++)
+            appendOne(list, command(i), true, time++);
+        const double appendNs = double(timer.nsecsElapsed()) / blockSize;
+
+        // repeated commands, moved to the end
+        std::uniform_int_distribution<int> dist(0, n + blockSize - 1);
+        timer.start();
+        for(int i = 0; i < blockSize; i++)
+            appendOne(list, command(dist(rng)), true, time++);
+        const double moveNs = double(timer.nsecsElapsed()) / blockSize;
+
+        std::printf("%10d %16.0f %16.0f\n", list.size(), appendNs, moveNs);
+    }
+    return 0;
+}
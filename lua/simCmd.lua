@@ -14,6 +14,8 @@ Use this plugin for quick evaluation of expressions.
         txt = txt ..
                   [[Begin to type the name of a function (e.g. "sim.getObjectHa") and press TAB to complete it.
 
+Type part of a previous command and press Ctrl+R to recall the most recent command containing it (press again for older matches).
+
 ]]
     else
         txt = txt ..
@@ -27,7 +29,9 @@ Use this plugin for quick evaluation of expressions.
 - **Enter**: accept completion (also works with '(' and '.').
 - **Esc**: clear text field.
 - **Up/Down** arrows: navigate/search through command history.
+- **Ctrl+R**: search command history for entries containing the typed text (press again for older matches).
 - **Ctrl+L**: clear statusbar.
+- **Ctrl+C**: interrupt the running command (if "Interruptible execution" is enabled; Lua only).
 
 ]]
     end
@@ -62,6 +66,11 @@ Some special variables are set automatically before each evaluation:
 - **apropos**: use this to search in the API symbols (functions and constants), e.g. apropos'inertia'.
 - **printBytes**: print a binary string in hexadecimal bytes, like hexdump.
 
+
+### Executing files
+
+simCmd.execFile(lang, path) executes the snippets of a file in order (see simCmd.execBatch for the other arguments). Snippets are separated by blank lines, so a snippet can span several lines (e.g. a function definition or a multi-line table) as long as it has no blank line itself.
+
 ]]
     return txt
 end
@@ -81,6 +90,29 @@ function simCmd.help()
     end
 end
 
+function simCmd.execFile(lang, path, history, undo, stopOnError)
+    -- execute a file made of snippets separated by blank lines (so that a
+    -- snippet can span several lines, e.g. a function definition, as long
+    -- as it has no blank line), see simCmd.execBatch
+    local snippets, lines = {}, {}
+    local function endSnippet()
+        if #lines > 0 then
+            table.insert(snippets, table.concat(lines, '\n'))
+            lines = {}
+        end
+    end
+    for line in io.lines(path) do
+        line = line:gsub('\r$', '')
+        if line:match('^%s*$') then
+            endSnippet()
+        else
+            table.insert(lines, line)
+        end
+    end
+    endSnippet()
+    return simCmd.execBatch(lang, snippets, history, undo, stopOnError)
+end
+
 function simCmd.helpClose()
     if ui then
         simUI.destroy(ui)
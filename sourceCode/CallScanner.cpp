@@ -0,0 +1,277 @@
+#include "CallScanner.h"
+#include <algorithm>
+#include <QSet>
+#include <QStringList>
+
+void CallScanner::setLanguage(Language lang)
+{
+    if(lang == lang_) return;
+    lang_ = lang;
+    reset();
+}
+
+/*!
+ * \brief Find the innermost call enclosing pos
+ * \param text The code
+ * \param pos The cursor position
+ * \param call Where to store the callee, the position of its open
+ * parenthesis, and the index of the argument pos is in
+ * \return false if pos is not inside the parentheses of a call (e.g. is
+ * inside those of a function definition, or inside a string or a comment)
+ */
+bool CallScanner::enclosingCall(const QString &text, int pos, Call *call)
+{
+    pos = std::min(pos, int(text.length()));
+    if(pos < scanned_ || !text.startsWith(QStringView(text_).left(scanned_)))
+        reset();
+    text_ = text;
+    scan(text, pos);
+
+    if(state_ != Code) return false;
+
+    for(int b = brackets_.size() - 1; b >= 0; b--)
+    {
+        if(brackets_[b].ch != '(') continue;
+
+        int end = brackets_[b].pos;
+        while(end > 0 && text[end - 1].isSpace())
+            end--;
+        int start = end;
+        while(start > 0)
+        {
+            const QChar c = text[start - 1];
+            if(!c.isLetterOrNumber() && c != '_' && c != '.' && !(lang_ == Lua && c == ':')) break;
+            start--;
+        }
+        QString callee = text.mid(start, end - start);
+
+        // a parenthesized expression (or an anonymous function), not a call
+        static const QSet<QString> luaKeywords = {
+            "and", "or", "not", "if", "elseif", "while", "until", "return",
+            "in", "for", "local", "then", "do", "else", "function"
+        };
+        static const QSet<QString> pythonKeywords = {
+            "and", "or", "not", "if", "elif", "while", "return", "in", "for",
+            "assert", "lambda", "yield", "is", "with", "del", "except",
+            "else", "raise", "await"
+        };
+        const QSet<QString> &keywords = lang_ == Lua ? luaKeywords : pythonKeywords;
+        if(callee.isEmpty() || keywords.contains(callee) || callee[0].isDigit())
+            return false;
+
+        // the parameters of a definition ("function f(", "def f(", "class
+        // C("), not a call
+        if(isDefinition(text, start))
+            return false;
+
+        call->callee = callee;
+        call->openPos = brackets_[b].pos;
+        call->argIndex = brackets_[b].argIndex;
+        return true;
+    }
+    return false;
+}
+
+/*!
+ * \brief Make the argIndex-th parameter of a calltip bold
+ *
+ * The parameters are those in the first parentheses of each line of the
+ * calltip. Returns the calltip as it is if nothing could be highlighted,
+ * otherwise returns it as rich text.
+ */
+QString CallScanner::highlightArgument(const QString &tip, int argIndex)
+{
+    if(argIndex < 0) return tip;
+
+    bool highlighted = false;
+    QStringList lines = tip.split('\n');
+    for(QString &line : lines)
+    {
+        int open = line.indexOf('(');
+        int start = open + 1, end = -1, arg = 0, depth = 0;
+        for(int i = start; open >= 0 && i < line.length() && end < 0; i++)
+        {
+            const QChar c = line[i];
+            if(c == '(' || c == '[' || c == '{' || c == '<')
+                depth++;
+            else if((c == ')' || c == ']' || c == '}' || c == '>') && depth > 0)
+                depth--;
+            else if((c == ',' || c == ')') && depth == 0)
+            {
+                if(arg == argIndex)
+                    end = i;
+                else if(c == ',')
+                    start = i + 1, arg++;
+                else
+                    break;
+            }
+        }
+        if(end < 0)
+        {
+            line = line.toHtmlEscaped();
+            continue;
+        }
+        line = line.left(start).toHtmlEscaped()
+            + "<b>" + line.mid(start, end - start).toHtmlEscaped() + "</b>"
+            + line.mid(end).toHtmlEscaped();
+        highlighted = true;
+    }
+    if(!highlighted) return tip;
+    return "<p style='white-space:pre'>" + lines.join("<br>") + "</p>";
+}
+
+/*!
+ * \brief Check whether the name starting at pos follows a keyword
+ * introducing a definition
+ */
+bool CallScanner::isDefinition(const QString &text, int pos) const
+{
+    int end = pos;
+    while(end > 0 && text[end - 1].isSpace())
+        end--;
+    int start = end;
+    while(start > 0 && (text[start - 1].isLetterOrNumber() || text[start - 1] == '_'))
+        start--;
+    const QStringView word = QStringView(text).mid(start, end - start);
+    if(lang_ == Lua)
+        return word == QLatin1String("function");
+    return word == QLatin1String("def") || word == QLatin1String("class");
+}
+
+void CallScanner::reset()
+{
+    text_.clear();
+    scanned_ = 0;
+    state_ = Code;
+    level_ = 0;
+    brackets_.clear();
+}
+
+/*!
+ * \brief Check for a Lua long bracket ("[[", "[=[", ...) at i
+ * \return 1 if found (level is set to the number of '='), 0 if not, -1 if
+ * the text ends before it can be decided
+ */
+int CallScanner::longBracket(const QString &text, int i, int end, int *level) const
+{
+    int j = i + 1;
+    while(j < end && text[j] == '=') j++;
+    if(j >= end) return -1;
+    if(text[j] != '[') return 0;
+    *level = j - i - 1;
+    return 1;
+}
+
+/*!
+ * \brief Scan the text from where the last scan stopped up to end
+ *
+ * Tokens which can't be decided without looking past end (e.g. a '-'
+ * which may start a comment) are left for the next scan.
+ */
+void CallScanner::scan(const QString &text, int end)
+{
+    int i = scanned_;
+    while(i < end)
+    {
+        const QChar c = text[i];
+        const bool lua = lang_ == Lua;
+        int n = 1;
+
+        if(state_ == Code)
+        {
+            if(lua && c == '-')
+            {
+                if(i + 1 >= end) break;
+                if(text[i + 1] == '-')
+                {
+                    if(i + 2 >= end) break;
+                    int r = text[i + 2] == '[' ? longBracket(text, i + 2, end, &level_) : 0;
+                    if(r < 0) break;
+                    state_ = r ? LongComment : LineComment;
+                    n = r ? 4 + level_ : 2;
+                }
+            }
+            else if(!lua && c == '#')
+            {
+                state_ = LineComment;
+            }
+            else if(c == '"' || c == '\'')
+            {
+                // in Python, '' may be an empty string or start a triple
+                // quoted one
+                if(!lua && i + 2 >= end && i + 1 < end && text[i + 1] == c) break;
+                quote_ = c;
+                state_ = String;
+                if(!lua && i + 2 < end && text[i + 1] == c && text[i + 2] == c)
+                    state_ = LongString, n = 3;
+            }
+            else if(lua && c == '[' && (i + 1 >= end || text[i + 1] == '[' || text[i + 1] == '='))
+            {
+                int r = longBracket(text, i, end, &level_);
+                if(r < 0) break;
+                if(r)
+                    state_ = LongString, n = 2 + level_;
+                else
+                    brackets_.push_back({c, i, 0});
+            }
+            else if(c == '(' || c == '[' || c == '{')
+            {
+                brackets_.push_back({c, i, 0});
+            }
+            else if((c == ')' || c == ']' || c == '}') && !brackets_.isEmpty())
+            {
+                brackets_.pop_back();
+            }
+            else if(c == ',' && !brackets_.isEmpty())
+            {
+                brackets_.last().argIndex++;
+            }
+        }
+        else if(state_ == String)
+        {
+            if(c == '\\')
+            {
+                if(i + 1 >= end) break;
+                n = 2;
+            }
+            else if(c == quote_ || c == '\n')
+            {
+                state_ = Code;
+            }
+        }
+        else if(state_ == LongString && !lua)
+        {
+            if(c == '\\')
+            {
+                if(i + 1 >= end) break;
+                n = 2;
+            }
+            else if(c == quote_)
+            {
+                if(i + 2 >= end) break;
+                if(text[i + 1] == c && text[i + 2] == c)
+                    state_ = Code, n = 3;
+            }
+        }
+        else if(state_ == LongString || state_ == LongComment)
+        {
+            if(c == ']')
+            {
+                // closing long bracket of the same level
+                if(i + level_ + 1 >= end) break;
+                int j = i + 1;
+                while(j < i + 1 + level_ && text[j] == '=') j++;
+                if(j == i + 1 + level_ && text[j] == ']')
+                    state_ = Code, n = level_ + 2;
+            }
+        }
+        else if(state_ == LineComment)
+        {
+            if(c == '\n')
+                state_ = Code;
+        }
+
+        i += n;
+    }
+    scanned_ = std::min(i, end);
+}
@@ -0,0 +1,57 @@
+#ifndef CALLSCANNER_H_INCLUDED
+#define CALLSCANNER_H_INCLUDED
+
+#include <QString>
+#include <QVector>
+
+// Lexical scanner for Lua and Python code, finding the call enclosing a
+// position (callee and index of the argument), for showing calltips
+// without asking the script.
+//
+// It only tracks what is needed for that: strings (including Lua long
+// brackets and Python triple quotes), comments, and brackets. The state at
+// the end of the last scan is kept, so when the text is only extended
+// (i.e. typing at the end), only the new characters are scanned.
+
+class CallScanner
+{
+public:
+    enum Language {Lua, Python};
+
+    struct Call
+    {
+        QString callee;
+        int openPos;
+        int argIndex;
+    };
+
+    void setLanguage(Language lang);
+    bool enclosingCall(const QString &text, int pos, Call *call);
+
+    static QString highlightArgument(const QString &tip, int argIndex);
+
+private:
+    struct Bracket
+    {
+        QChar ch;
+        int pos;
+        int argIndex;
+    };
+
+    enum State {Code, String, LongString, LineComment, LongComment};
+
+    bool isDefinition(const QString &text, int pos) const;
+    void reset();
+    void scan(const QString &text, int end);
+    int longBracket(const QString &text, int i, int end, int *level) const;
+
+    Language lang_ = Lua;
+    QString text_;
+    int scanned_ = 0;
+    State state_ = Code;
+    QChar quote_;
+    int level_ = 0;
+    QVector<Bracket> brackets_;
+};
+
+#endif // CALLSCANNER_H_INCLUDED
@@ -0,0 +1,85 @@
+#include "CompletionCache.h"
+#include <algorithm>
+
+bool CompletionCache::Key::operator==(const Key &o) const
+{
+    return scriptHandle == o.scriptHandle && lang == o.lang && context == o.context;
+}
+
+uint qHash(const CompletionCache::Key &key, uint seed)
+{
+    return qHash(key.context, seed) ^ qHash(key.lang, seed) ^ uint(key.scriptHandle * 31);
+}
+
+CompletionCache::Key CompletionCache::key(int scriptHandle, const QString &lang, const QString &input, int pos)
+{
+    pos = std::min(pos, int(input.length()));
+    QString context = SymbolIndex::completionContext(input, pos);
+    // a method ("obj:na") is not the same as a global ("na")
+    const int start = pos - context.length();
+    if(start > 0 && input[start - 1] == ':')
+        context = SymbolIndex::completionContext(input, start - 1) + ":" + context;
+    if(context.isEmpty())
+        context = input.left(pos);
+    return {scriptHandle, lang, context};
+}
+
+/*!
+ * \brief Get the cached completions for the name before pos in input
+ *
+ * For a member ("foo.b", "obj:b"), the completions of the namespace
+ * ("foo.", "obj:", e.g. prefetched when '.' was typed) are used too,
+ * narrowed to the part of the member already typed.
+ *
+ * \return false if not cached, or if the cached entry has expired
+ */
+bool CompletionCache::lookup(int scriptHandle, const QString &lang, const QString &input, int pos, QStringList *completions) const
+{
+    Key k = key(scriptHandle, lang, input, pos);
+    auto it = entries_.constFind(k);
+    if(it != entries_.constEnd() && !it->age.hasExpired(maxAge_))
+    {
+        *completions = it->completions;
+        return true;
+    }
+
+    int sep = k.context.length() - 1;
+    while(sep > 0 && k.context[sep] != '.' && k.context[sep] != ':')
+        sep--;
+    if(sep <= 0 || sep == k.context.length() - 1)
+        return false;
+    const QString member = k.context.mid(sep + 1);
+    k.context.truncate(sep + 1);
+    it = entries_.constFind(k);
+    if(it == entries_.constEnd() || it->age.hasExpired(maxAge_))
+        return false;
+    completions->clear();
+    for(const QString &s : it->completions)
+        if(s.startsWith(member))
+            *completions << s.mid(member.length());
+    return true;
+}
+
+void CompletionCache::insert(int scriptHandle, const QString &lang, const QString &input, int pos, const QStringList &completions)
+{
+    if(maxAge_ <= 0) return;
+
+    // entries are only useful for a short time: rather than tracking their
+    // use, just start over when full
+    if(entries_.size() >= maxEntries)
+        entries_.clear();
+
+    Entry &e = entries_[key(scriptHandle, lang, input, pos)];
+    e.completions = completions;
+    e.age.start();
+}
+
+void CompletionCache::clear()
+{
+    entries_.clear();
+}
+
+QString CompletionSnapshot::key(int scriptHandle, const QString &lang, const QString &input, int pos)
+{
+    return QString("%1:%2:%3:").arg(scriptHandle).arg(lang.toLower()).arg(pos) + input;
+}
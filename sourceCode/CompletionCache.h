@@ -0,0 +1,89 @@
+#ifndef COMPLETIONCACHE_H_INCLUDED
+#define COMPLETIONCACHE_H_INCLUDED
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QMetaType>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QWaitCondition>
+#include "SymbolIndex.h"
+
+// Results of _getCompletion, keyed by the script, the language and the
+// completion context: the (possibly dotted) name before the cursor, so that
+// e.g. "x = foo.b" and "print(foo.b" share the entry. The completions are
+// suffixes to insert at the cursor, so they don't depend on the rest of the
+// line. When there is no name before the cursor, the whole line up to the
+// cursor is used instead.
+//
+// The cache is invalidated when something may have changed the globals
+// of the scripts (code executed, scripts created, erased or restarted,
+// scene loaded, ...); since scripts can also change by themselves (e.g.
+// while simulation is running) entries also expire after maxAge ms.
+//
+// Only used from the SIM thread.
+
+class CompletionCache
+{
+public:
+    bool lookup(int scriptHandle, const QString &lang, const QString &input, int pos, QStringList *completions) const;
+    void insert(int scriptHandle, const QString &lang, const QString &input, int pos, const QStringList &completions);
+    void clear();
+
+    inline void setMaxAge(int maxAge) {maxAge_ = maxAge;}
+
+private:
+    struct Key
+    {
+        int scriptHandle;
+        QString lang;
+        QString context;
+
+        bool operator==(const Key &o) const;
+    };
+
+    static Key key(int scriptHandle, const QString &lang, const QString &input, int pos);
+
+    struct Entry
+    {
+        QStringList completions;
+        QElapsedTimer age;
+    };
+
+    friend uint qHash(const Key &key, uint seed);
+
+    QHash<Key, Entry> entries_;
+    int maxAge_ = 5000;
+    static const int maxEntries = 256;
+};
+
+// Read-only copy of what is needed to answer completion requests without
+// the SIM thread (API symbols, completions computed recently), published
+// by SIM for the headless console thread. A new snapshot is made for each
+// change, and swapped in atomically.
+
+struct CompletionSnapshot
+{
+    QMap<QString, SymbolIndex> symbols;
+    QHash<QString, QStringList> completions;
+
+    static QString key(int scriptHandle, const QString &lang, const QString &input, int pos);
+};
+
+// Result of a completion request made from another thread, which may stop
+// waiting for it.
+
+struct CompletionReply
+{
+    QMutex mutex;
+    QWaitCondition done;
+    bool ready = false;
+    QStringList completions;
+};
+
+Q_DECLARE_METATYPE(QSharedPointer<CompletionReply>)
+
+#endif // COMPLETIONCACHE_H_INCLUDED
@@ -0,0 +1,91 @@
+#include "CompletionPopup.h"
+#include <algorithm>
+#include <QScrollBar>
+
+CompletionModel::CompletionModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+}
+
+/*!
+ * \brief Set the completions to list
+ * \param prefix Text shown before each completion (e.g. what has been typed
+ * of the name being completed)
+ */
+void CompletionModel::setCompletions(const QStringList &completions, const QString &prefix)
+{
+    beginResetModel();
+    completions_ = completions;
+    prefix_ = prefix;
+    endResetModel();
+}
+
+int CompletionModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : completions_.size();
+}
+
+QVariant CompletionModel::data(const QModelIndex &index, int role) const
+{
+    if(!index.isValid() || index.row() >= completions_.size())
+        return QVariant();
+    if(role == Qt::DisplayRole)
+        return prefix_ + completions_[index.row()];
+    return QVariant();
+}
+
+CompletionPopup::CompletionPopup(QWidget *editor)
+    : QListView(editor)
+{
+    setWindowFlags(Qt::ToolTip | Qt::FramelessWindowHint);
+    setFocusPolicy(Qt::NoFocus);
+    setAttribute(Qt::WA_ShowWithoutActivating);
+    setUniformItemSizes(true);
+    setSelectionMode(QAbstractItemView::SingleSelection);
+    setEditTriggers(QAbstractItemView::NoEditTriggers);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setFont(editor->font());
+
+    model_ = new CompletionModel(this);
+    setModel(model_);
+
+    connect(this, &QListView::clicked, this, [this](const QModelIndex &index) {
+        emit activated(index.row());
+    });
+}
+
+/*!
+ * \brief Show the completions, with the first one selected
+ * \param pos Position (global) of the top left corner of the popup
+ */
+void CompletionPopup::showCompletions(const QStringList &completions, const QString &prefix, const QPoint &pos)
+{
+    model_->setCompletions(completions, prefix);
+
+    // size to at most 10 rows; the width is taken from the first rows only,
+    // as measuring every completion would defeat the point of the popup
+    const int rowHeight = sizeHintForRow(0);
+    const int rows = std::min(int(completions.size()), 10);
+    int width = 0;
+    for(int i = 0; i < std::min(int(completions.size()), 50); i++)
+        width = std::max(width, fontMetrics().horizontalAdvance(prefix + completions[i]));
+    width += verticalScrollBar()->sizeHint().width() + 2 * frameWidth() + 8;
+    resize(std::max(width, 200), rows * rowHeight + 2 * frameWidth());
+
+    move(pos);
+    setCurrentIndex(model_->index(0));
+    show();
+}
+
+void CompletionPopup::moveSelection(int delta)
+{
+    const int n = model_->rowCount();
+    if(n == 0) return;
+    int row = std::max(0, std::min(currentRow() + delta, n - 1));
+    setCurrentIndex(model_->index(row));
+}
+
+int CompletionPopup::currentRow() const
+{
+    return currentIndex().isValid() ? currentIndex().row() : -1;
+}
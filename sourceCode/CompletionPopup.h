@@ -0,0 +1,52 @@
+#ifndef COMPLETIONPOPUP_H_INCLUDED
+#define COMPLETIONPOPUP_H_INCLUDED
+
+#include <QAbstractListModel>
+#include <QListView>
+#include <QStringList>
+
+// List model over a list of completions; the list is implicitly shared
+// with the caller, so setting it does not copy the candidates.
+
+class CompletionModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit CompletionModel(QObject *parent = nullptr);
+
+    void setCompletions(const QStringList &completions, const QString &prefix);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private:
+    QStringList completions_;
+    QString prefix_;
+};
+
+// Popup list of completions, shown under the cursor of an editor which
+// keeps the keyboard focus and forwards the navigation keys.
+//
+// Items have uniform sizes, so that only the visible rows are laid out
+// and painted, regardless of the number of completions.
+
+class CompletionPopup : public QListView
+{
+    Q_OBJECT
+
+public:
+    explicit CompletionPopup(QWidget *editor);
+
+    void showCompletions(const QStringList &completions, const QString &prefix, const QPoint &pos);
+    void moveSelection(int delta);
+    int currentRow() const;
+
+signals:
+    void activated(int row);
+
+private:
+    CompletionModel *model_;
+};
+
+#endif // COMPLETIONPOPUP_H_INCLUDED
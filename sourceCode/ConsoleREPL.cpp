@@ -1,10 +1,31 @@
 #include "ConsoleREPL.h"
+#include <csignal>
 #include <iostream>
+#include <limits>
 
 #include <simPlusPlus-2/Lib.h>
+#include "SIM.h"
 
+static void (*oldSigintHandler)(int) = SIG_DFL;
 
-Readline::Readline(QObject *parent) : QThread(parent)
+/*!
+ * \brief SIGINT handler used while code runs: interrupts the code if it has
+ * the interrupt hook, otherwise does what Ctrl+C did before
+ */
+static void onSigint(int sig)
+{
+    if(SIM::requestInterrupt()) return;
+    if(oldSigintHandler == SIG_IGN) return;
+    if(oldSigintHandler == SIG_DFL)
+    {
+        std::signal(sig, SIG_DFL);
+        std::raise(sig);
+        return;
+    }
+    oldSigintHandler(sig);
+}
+
+Readline::Readline(QObject *parent, QSharedPointer<HistoryList> history_) : QThread(parent), history(history_)
 {
     havePython = !*sim::getBoolProperty(sim_handle_app, "signal.pythonSandboxInitFailed", false);
     scriptHandle = -1;
@@ -24,37 +45,89 @@ Readline::Readline(QObject *parent) : QThread(parent)
 
     QThread::setTerminationEnabled(true);
     rx.install_window_change_handler();
-    rx.set_max_history_size(128);
     rx.set_max_hint_rows(3);
     rx.set_no_color(false);
     rx.set_word_break_characters(" \n\t,-%!;:=*~^'\"/?<>|[](){}");
     rx.set_completion_count_cutoff(128);
     using namespace std::placeholders;
     rx.set_completion_callback(std::bind(&Readline::hook_completion, this, _1, _2));
+    rx.set_hint_callback(std::bind(&Readline::hook_hint, this, _1, _2, _3));
+    rx.bind_key(Replxx::KEY::control('R'), std::bind(&Readline::hook_search, this, _1));
+}
+
+/*!
+ * \brief Set the options read from the app properties
+ *
+ * Can be called from any thread (i.e. at each instance pass); the history
+ * options are applied to replxx before the next prompt.
+ */
+void Readline::setOptions(bool rankHistory_, int completionTimeout_, bool removeDups, int maxHistorySize)
+{
+    rankHistory = rankHistory_;
+    completionTimeout = completionTimeout_;
+    historyRemoveDups = removeDups;
+    historyMaxSize = maxHistorySize;
+}
+
+/*!
+ * \brief Bring the replxx history up to date with the shared history
+ *
+ * Lines entered in the console go to the shared history (thru SIM), as do
+ * commands executed in other ways (e.g. simCmd.exec); replxx is then given
+ * the entries appended since the last sync, with the same rules, which
+ * keeps the two in sync. It is rebuilt from scratch only when positions
+ * have changed (see HistoryList::generation()).
+ */
+void Readline::syncHistory()
+{
+    rx.set_unique_history(historyRemoveDups);
+    const int maxSize = historyMaxSize;
+    rx.set_max_history_size(maxSize >= 0 ? maxSize : std::numeric_limits<int>::max());
+
+    QReadLocker locker(history->lock());
+    if(history->revision() == historyRevision) return;
+    historyRevision = history->revision();
+    if(history->generation() != historyGeneration)
+    {
+        historyGeneration = history->generation();
+        historySynced = -1;
+        rx.history_clear();
+    }
+    for(int i = history->next(historySynced); i < history->end(); i = history->next(i))
+        rx.history_add(history->utf8At(i).toStdString());
+    historySynced = history->end() - 1;
 }
 
 void Readline::run()
 {
     while(!QThread::currentThread()->isInterruptionRequested())
     {
+        syncHistory();
         const char *line = rx.input("> ");
         if(line && *line)
         {
-            rx.history_add(line);
             QString line_ = QString::fromUtf8(line);
+            searchIndex = -1;
             if(line_.length() > 1 && QString("@lua").startsWith(line_))
             {
+                emit appendHistory(line_);
                 if(scriptHandle == sandboxScript)
                     setSelectedScript(sandboxScript, "Lua");
             }
             else if(line_.length() > 1 && QString("@python").startsWith(line_))
             {
+                emit appendHistory(line_);
                 if(scriptHandle == sandboxScript)
                     setSelectedScript(sandboxScript, "Python");
             }
             else
             {
+                // while the code runs, Ctrl+C interrupts it (if enabled by
+                // customData.simCmd.interruptibleExec) instead of quitting
+                oldSigintHandler = std::signal(SIGINT, onSigint);
                 emit execCode(scriptHandle, "@" + lang.toLower(), line_);
+                if(oldSigintHandler != SIG_ERR)
+                    std::signal(SIGINT, oldSigintHandler);
             }
         }
         else if(!line) // EOF
@@ -72,13 +145,120 @@ Replxx::completions_t Readline::hook_completion(const std::string &context, int
     QStringList completions;
     QString langSuffix;
     if(lang != "") langSuffix = "@" + lang.toLower();
-    emit askCompletion(scriptHandle, langSuffix, input, contextLen, &completions);
+
+    // answer from the snapshot published by SIM if possible, otherwise ask
+    // SIM, but don't wait for it forever (the result will be in the next
+    // snapshot anyway)
+    //
+    // the cursor is at the end of the input (contextLen is the length of
+    // the word being completed, not a position)
+    const int pos = input.length();
+    auto snapshot = SIM::getInstance()->completionSnapshot();
+    const QString name = SymbolIndex::completionContext(input, pos);
+    auto symbols = snapshot->symbols.constFind(SIM::symbolsKey(scriptHandle, langSuffix));
+    auto hit = snapshot->completions.constFind(CompletionSnapshot::key(scriptHandle, langSuffix, input, pos));
+    if(symbols != snapshot->symbols.constEnd() && symbols->coversContext(name))
+    {
+        for(const QString &s : symbols->complete(name))
+            completions << (input + s);
+    }
+    else if(hit != snapshot->completions.constEnd())
+    {
+        completions = hit.value();
+    }
+    else
+    {
+        QSharedPointer<CompletionReply> reply(new CompletionReply);
+        emit askCompletion(reply, scriptHandle, langSuffix, input, pos);
+        QMutexLocker locker(&reply->mutex);
+        if(reply->ready || reply->done.wait(&reply->mutex, completionTimeout.load()))
+            completions = reply->completions;
+    }
+
     Replxx::completions_t ret;
     for(const auto &completion : completions)
         ret.emplace_back(completion.toUtf8().data(), Replxx::Color::DEFAULT);
     return ret;
 }
 
+/*!
+ * \brief Hint the rest of the line from history, or else the API names
+ * matching the name at the end of the input
+ *
+ * Runs on every keystroke, so it only looks at the shared history and at
+ * the completion snapshot, and never waits for the SIM thread.
+ */
+Replxx::hints_t Readline::hook_hint(const std::string &context, int &contextLen, Replxx::Color &color)
+{
+    Replxx::hints_t ret;
+    QString input = QString::fromStdString(context);
+    if(input.isEmpty())
+        return ret;
+    color = Replxx::Color::GRAY;
+
+    {
+        QReadLocker locker(history->lock());
+        int i = rankHistory ? history->bestMatch(input) : history->prevMatch(history->end(), input);
+        if(i >= 0 && history->at(i) != input)
+        {
+            contextLen = input.toUcs4().size();
+            ret.emplace_back(history->utf8At(i).toStdString());
+            return ret;
+        }
+    }
+
+    QString langSuffix;
+    if(lang != "") langSuffix = "@" + lang.toLower();
+    auto snapshot = SIM::getInstance()->completionSnapshot();
+    auto symbols = snapshot->symbols.constFind(SIM::symbolsKey(scriptHandle, langSuffix));
+    if(symbols == snapshot->symbols.constEnd())
+    {
+        // load them for the next keystrokes (once per snapshot)
+        if(apiSymbolsAsked != snapshot)
+        {
+            apiSymbolsAsked = snapshot;
+            emit askApiSymbols(scriptHandle, langSuffix);
+        }
+        return ret;
+    }
+
+    const QString name = SymbolIndex::completionContext(input, input.length());
+    if(!symbols->coversContext(name))
+        return ret;
+    contextLen = name.toUcs4().size();
+    for(const QString &s : symbols->complete(name))
+    {
+        ret.emplace_back((name + s).toStdString());
+        if(ret.size() >= 8) break;
+    }
+    return ret;
+}
+
+Replxx::ACTION_RESULT Readline::hook_search(char32_t code)
+{
+    // search history for entries containing the current input;
+    // pressing Ctrl+R again (input unchanged) goes to the previous match
+    QString input = QString::fromUtf8(rx.get_state().text());
+    QReadLocker locker(history->lock());
+    int from = history->end();
+    if(searchIndex != -1 && input == searchMatch && searchGeneration == history->generation())
+        from = searchIndex;
+    else
+        searchQuery = input;
+    if(searchQuery.isEmpty())
+        return Replxx::ACTION_RESULT::CONTINUE;
+    int i = history->search(from, searchQuery);
+    if(i < 0)
+        return Replxx::ACTION_RESULT::CONTINUE;
+    searchIndex = i;
+    searchGeneration = history->generation();
+    searchMatch = history->at(i);
+    locker.unlock();
+    std::string match = searchMatch.toStdString();
+    rx.set_state(Replxx::State(match.c_str(), searchMatch.toUcs4().size()));
+    return Replxx::ACTION_RESULT::CONTINUE;
+}
+
 void Readline::setSelectedScript(int newScriptHandle, QString newLang)
 {
     if(newScriptHandle == -1)
@@ -2,9 +2,15 @@
 
 #include <QThread>
 #include <QStringList>
+#include <QSharedPointer>
+#include <atomic>
+#include <memory>
 
 #include <replxx.hxx>
 
+#include "HistoryList.h"
+#include "CompletionCache.h"
+
 using Replxx = replxx::Replxx;
 
 class Readline : public QThread
@@ -12,22 +18,42 @@ class Readline : public QThread
     Q_OBJECT
 
 public:
-    Readline(QObject *parent);
+    Readline(QObject *parent, QSharedPointer<HistoryList> history);
+    void setOptions(bool rankHistory, int completionTimeout, bool removeDups, int maxHistorySize);
     void run() override;
     Replxx::completions_t hook_completion(const std::string &context, int &contextLen);
+    Replxx::hints_t hook_hint(const std::string &context, int &contextLen, Replxx::Color &color);
+    Replxx::ACTION_RESULT hook_search(char32_t code);
 
 public slots:
     void setSelectedScript(int scriptHandle, QString lang);
 
 signals:
     void execCode(int scriptHandle, QString langSuffix, QString code);
-    void askCompletion(int scriptHandle, QString langSuffix, QString input, int pos, QStringList *cl);
+    void appendHistory(QString cmd);
+    void askCompletion(QSharedPointer<CompletionReply> reply, int scriptHandle, QString langSuffix, QString input, int pos);
+    void askApiSymbols(int scriptHandle, QString langSuffix);
 
 private:
+    void syncHistory();
+
     Replxx rx;
     int sandboxScript;
     QString preferredSandboxLang;
     int scriptHandle;
     QString lang;
     bool havePython;
+    std::atomic<int> completionTimeout{1000};
+    std::atomic<bool> rankHistory{false};
+    std::atomic<bool> historyRemoveDups{false};
+    std::atomic<int> historyMaxSize{1000};
+    std::shared_ptr<const CompletionSnapshot> apiSymbolsAsked;
+    QSharedPointer<HistoryList> history;
+    quint64 historyRevision{0};
+    quint64 historyGeneration{0};
+    int historySynced{-1};
+    QString searchQuery;
+    QString searchMatch;
+    int searchIndex{-1};
+    quint64 searchGeneration{0};
 };
@@ -0,0 +1,144 @@
+#include "FuzzyMatcher.h"
+#include <algorithm>
+#include <vector>
+
+static const int scoreMatch = 16;
+static const int bonusStart = 24;
+static const int bonusBoundary = 20;
+static const int bonusConsecutive = 12;
+static const int bonusCase = 1;
+static const int penaltyGap = 1;
+static const int maxGapPenalty = 8;
+
+static inline bool isBoundary(const QString &s, int i)
+{
+    if(i == 0) return true;
+    const QChar prev = s[i - 1], c = s[i];
+    if(prev == '_' || prev == '.') return c != '_' && c != '.';
+    if(c.isUpper() && !prev.isUpper()) return true;
+    if(c.isDigit() && !prev.isDigit()) return true;
+    return false;
+}
+
+FuzzyMatcher::FuzzyMatcher(const QString &pattern)
+    : pattern_(pattern),
+      patternLower_(pattern.toLower()),
+      mask_(charMask(pattern))
+{
+}
+
+/*!
+ * \brief Compute the set of characters of a string, as a bitmask
+ *
+ * Bits 0-25 are for letters (regardless of case), bit 26 for digits,
+ * bit 27 for '_', bit 28 for anything else.
+ */
+quint32 FuzzyMatcher::charMask(const QString &s)
+{
+    quint32 mask = 0;
+    for(const QChar &qc : s)
+    {
+        const ushort c = qc.unicode();
+        if(c >= 'a' && c <= 'z') mask |= 1u << (c - 'a');
+        else if(c >= 'A' && c <= 'Z') mask |= 1u << (c - 'A');
+        else if(c >= '0' && c <= '9') mask |= 1u << 26;
+        else if(c == '_') mask |= 1u << 27;
+        else mask |= 1u << 28;
+    }
+    return mask;
+}
+
+/*!
+ * \brief Score a candidate
+ * \return the score (higher is better), or noMatch if it does not match
+ */
+int FuzzyMatcher::score(const QString &candidate) const
+{
+    return score(candidate, charMask(candidate));
+}
+
+/*!
+ * \brief Score a candidate, whose charMask() is already known
+ * \return the score (higher is better), or noMatch if it does not match
+ */
+int FuzzyMatcher::score(const QString &candidate, quint32 candidateMask) const
+{
+    if((candidateMask & mask_) != mask_) return noMatch;
+    if(pattern_.length() > candidate.length()) return noMatch;
+
+    // jumping ahead to the next boundary may miss a match that taking
+    // the first occurrence of each character would find, so try both
+    int s = match(candidate, true);
+    if(s == noMatch) s = match(candidate, false);
+    return s;
+}
+
+int FuzzyMatcher::match(const QString &candidate, bool preferBoundaries) const
+{
+    int total = 0;
+    int prev = -1;
+    int pos = 0;
+    const int n = candidate.length();
+    for(int k = 0; k < patternLower_.length(); k++)
+    {
+        const QChar pc = patternLower_[k];
+        int found = -1;
+        if(preferBoundaries)
+        {
+            for(int i = pos; i < n; i++)
+            {
+                if(candidate[i].toLower() != pc) continue;
+                if(found == -1) found = i;
+                if(i == prev + 1 || isBoundary(candidate, i)) {found = i; break;}
+            }
+        }
+        else
+        {
+            for(int i = pos; i < n && found == -1; i++)
+                if(candidate[i].toLower() == pc)
+                    found = i;
+        }
+        if(found == -1) return noMatch;
+
+        total += scoreMatch;
+        if(found == 0) total += bonusStart;
+        else if(isBoundary(candidate, found)) total += bonusBoundary;
+        if(found == prev + 1 && prev >= 0) total += bonusConsecutive;
+        if(candidate[found] == pattern_[k]) total += bonusCase;
+        if(prev >= 0) total -= std::min((found - prev - 1) * penaltyGap, maxGapPenalty);
+        else total -= std::min(found * penaltyGap, maxGapPenalty);
+
+        prev = found;
+        pos = found + 1;
+    }
+    // prefer shorter candidates
+    total -= (n - patternLower_.length()) / 4;
+    return total;
+}
+
+/*!
+ * \brief Filter and sort candidates by how well they match pattern
+ * \param masks The charMask() of each candidate, if known
+ * \return the matching candidates, best first (ties sorted alphabetically)
+ */
+QStringList FuzzyMatcher::rank(const QString &pattern, const QStringList &candidates, const std::vector<quint32> &masks)
+{
+    FuzzyMatcher m(pattern);
+    const bool haveMasks = int(masks.size()) == candidates.size();
+    std::vector<std::pair<int, int>> scored; // (score, index)
+    scored.reserve(candidates.size());
+    for(int i = 0; i < candidates.size(); i++)
+    {
+        int s = haveMasks ? m.score(candidates[i], masks[i]) : m.score(candidates[i]);
+        if(s != noMatch) scored.emplace_back(s, i);
+    }
+    std::sort(scored.begin(), scored.end(), [&](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+        if(a.first != b.first) return a.first > b.first;
+        return candidates[a.second] < candidates[b.second];
+    });
+    QStringList ret;
+    ret.reserve(int(scored.size()));
+    for(const auto &x : scored)
+        ret << candidates[x.second];
+    return ret;
+}
@@ -0,0 +1,42 @@
+#ifndef FUZZYMATCHER_H_INCLUDED
+#define FUZZYMATCHER_H_INCLUDED
+
+#include <limits>
+#include <vector>
+#include <QString>
+#include <QStringList>
+
+// Case-insensitive subsequence matcher for completion, e.g. "gop" matches
+// "getObjectPosition".
+//
+// Candidates are first checked against a bitmask of the characters of the
+// pattern (one bit per letter, digits and '_'), which rejects most of them
+// without looking at the characters' order; the remaining ones are scored,
+// favoring matches at the start, at camelCase humps and after '_', and runs
+// of consecutive matches. Scores can be negative; noMatch means no match.
+//
+// The bitmasks of the candidates can be computed in advance (e.g. by
+// SymbolIndex) and passed along with them.
+
+class FuzzyMatcher
+{
+public:
+    explicit FuzzyMatcher(const QString &pattern);
+
+    static const int noMatch = std::numeric_limits<int>::min();
+
+    int score(const QString &candidate) const;
+    int score(const QString &candidate, quint32 candidateMask) const;
+
+    static quint32 charMask(const QString &s);
+    static QStringList rank(const QString &pattern, const QStringList &candidates, const std::vector<quint32> &masks = {});
+
+private:
+    int match(const QString &candidate, bool preferBoundaries) const;
+
+    QString pattern_;
+    QString patternLower_;
+    quint32 mask_;
+};
+
+#endif // FUZZYMATCHER_H_INCLUDED
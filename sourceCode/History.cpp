@@ -0,0 +1,433 @@
+#include "History.h"
+#include <QCborStreamReader>
+#include <QDateTime>
+#include <cstring>
+#include <limits>
+#include <QtEndian>
+#include <simPlusPlus-2/Lib.h>
+
+static const char cborIndefiniteArray = char(0x9f);
+static const char cborBreak = char(0xff);
+
+static void appendCborString(QByteArray &data, const QByteArray &utf8)
+{
+    const quint32 len = quint32(utf8.size());
+    if(len < 24)
+    {
+        data.append(char(0x60 | len));
+    }
+    else if(len < 0x100)
+    {
+        data.append(char(0x78));
+        data.append(char(len));
+    }
+    else if(len < 0x10000)
+    {
+        uchar be[2];
+        qToBigEndian<quint16>(quint16(len), be);
+        data.append(char(0x79));
+        data.append(reinterpret_cast<const char *>(be), 2);
+    }
+    else
+    {
+        uchar be[4];
+        qToBigEndian<quint32>(len, be);
+        data.append(char(0x7a));
+        data.append(reinterpret_cast<const char *>(be), 4);
+    }
+    data.append(utf8);
+}
+
+static const int cborFloatSize = 5;
+
+static void appendCborFloat(QByteArray &data, float f)
+{
+    quint32 bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    uchar be[4];
+    qToBigEndian<quint32>(bits, be);
+    data.append(char(0xfa));
+    data.append(reinterpret_cast<const char *>(be), 4);
+}
+
+static std::vector<float> readCborFloats(const QByteArray &data)
+{
+    std::vector<float> ret;
+    QCborStreamReader reader(data);
+    if(!reader.isArray()) return ret;
+    reader.enterContainer();
+    while(reader.lastError() == QCborError::NoError && reader.hasNext())
+    {
+        if(reader.isFloat())
+            ret.push_back(reader.toFloat());
+        else if(reader.isDouble())
+            ret.push_back(float(reader.toDouble()));
+        else
+            ret.push_back(-std::numeric_limits<float>::infinity());
+        reader.next();
+    }
+    if(reader.lastError() != QCborError::NoError)
+        ret.clear();
+    return ret;
+}
+
+History::History()
+    : list_(new HistoryList)
+{
+    list_->setPrefixIndexEnabled(true);
+    list_->setSearchIndexEnabled(true);
+}
+
+void History::load(const Options &opts)
+{
+    list_->clear();
+    noDups_ = false;
+    data_.clear();
+    scores_.clear();
+    itemSizes_.clear();
+    dataValid_ = false;
+    loaded_ = true;
+    dirty_ = false;
+
+    if(!opts.useFile)
+        log_.close();
+    else if(log_.isOpen() || log_.open(HistoryLog::defaultPath()))
+    {
+        std::vector<float> scores;
+        QStringList entries = log_.readTail(opts.skipRepeated, opts.removeDups, opts.maxSize, &scores);
+        list_->set(entries, scores);
+        noDups_ = opts.removeDups;
+        return;
+    }
+    else
+        sim::addLog(sim_verbosity_warnings, "using customData.simCmd.history as history store");
+
+    try
+    {
+        auto pdata = sim::getBufferProperty(sim_handle_app, "customData.simCmd.history", {});
+        if(!pdata) return;
+        auto pscores = sim::getBufferProperty(sim_handle_app, "customData.simCmd.historyScores", {});
+        QByteArray scores;
+        if(pscores) scores = QByteArray::fromStdString(*pscores);
+        loadData(QByteArray::fromRawData(pdata->data(), int(pdata->size())), scores, opts.maxSize);
+    }
+    catch(sim::api_error &ex)
+    {
+        sim::addLog(sim_verbosity_debug, "failed to read history");
+    }
+}
+
+/*!
+ * \brief Load the most recent entries from the encoded history
+ * \param data The CBOR array of strings
+ * \param scores The CBOR array of scores (ignored if not matching data)
+ * \param maxSize Maximum number of entries to load (-1 for no limit)
+ *
+ * A first pass only records where each item starts, skipping over the
+ * strings without decoding them; then only the last maxSize items are
+ * decoded. Their encoded bytes are kept as the encoded form of the history,
+ * so that it does not need to be re-encoded at the next save.
+ */
+void History::loadData(const QByteArray &data, const QByteArray &scores, int maxSize)
+{
+    QCborStreamReader reader(data);
+    if(!reader.isArray())
+    {
+        sim::addLog(sim_verbosity_warnings, "customData.simCmd.history is not a CBOR array (type = " + std::to_string(int(reader.type())) + ")");
+        return;
+    }
+
+    std::vector<qint64> offsets;
+    reader.enterContainer();
+    while(reader.lastError() == QCborError::NoError && reader.hasNext())
+    {
+        offsets.push_back(reader.currentOffset());
+        reader.next();
+    }
+    if(reader.lastError() != QCborError::NoError)
+    {
+        sim::addLog(sim_verbosity_warnings, "customData.simCmd.history contains invalid CBOR data: " + reader.lastError().toString().toStdString());
+        return;
+    }
+    const qint64 endOffset = reader.currentOffset();
+    offsets.push_back(endOffset);
+
+    const int numItems = int(offsets.size()) - 1;
+    const int first = maxSize >= 0 && numItems > maxSize ? numItems - maxSize : 0;
+    bool allStrings = true;
+    QStringList entries;
+    entries.reserve(numItems - first);
+    std::vector<float> itemScores = readCborFloats(scores);
+    if(int(itemScores.size()) != numItems)
+        itemScores.clear();
+    std::vector<float> entryScores;
+    for(int i = first; i < numItems; i++)
+    {
+        QCborStreamReader item(QByteArray::fromRawData(data.constData() + offsets[i], int(offsets[i + 1] - offsets[i])));
+        if(!item.isString())
+        {
+            sim::addLog(sim_verbosity_warnings, "customData.simCmd.history item is not a CBOR string");
+            allStrings = false;
+            continue;
+        }
+        QString cmd;
+        auto r = item.readString();
+        while(r.status == QCborStreamReader::Ok)
+        {
+            cmd += r.data;
+            r = item.readString();
+        }
+        entries << cmd;
+        if(!itemScores.empty())
+            entryScores.push_back(itemScores[i]);
+    }
+    list_->set(entries, entryScores);
+
+    if(allStrings)
+    {
+        data_.reserve(int(endOffset - offsets[first]) + 2);
+        data_.append(cborIndefiniteArray);
+        data_.append(data.constData() + offsets[first], int(endOffset - offsets[first]));
+        data_.append(cborBreak);
+        for(int i = first; i < numItems; i++)
+            itemSizes_.push_back(int(offsets[i + 1] - offsets[i]));
+        scores_.reserve(entries.size() * cborFloatSize + 2);
+        scores_.append(cborIndefiniteArray);
+        for(int i = 0; i < entries.size(); i++)
+            appendCborFloat(scores_, list_->score(i));
+        scores_.append(cborBreak);
+        dataValid_ = true;
+    }
+}
+
+/*!
+ * \brief Synchronously write the history, encoding it first if needed
+ */
+void History::save()
+{
+    if(!dataValid_)
+    {
+        QList<int> itemSizes;
+        data_ = encode(*list_, &itemSizes, &scores_);
+        itemSizes_.assign(itemSizes.begin(), itemSizes.end());
+        dataValid_ = true;
+    }
+    writeProperty(data_, scores_);
+    savedRev_ = revision();
+    dirty_ = false;
+}
+
+/*!
+ * \brief Write a history snapshot encoded by HistoryEncoder
+ * \param rev The revision the snapshot was taken at
+ *
+ * The snapshot is written even if the history has changed since it was
+ * taken (it is only slightly stale), but then the history stays dirty;
+ * otherwise it is also adopted as the new encoded form. It is dropped if a
+ * more recent state has been written in the meantime (see save()).
+ */
+void History::write(quint64 rev, const QByteArray &data, const QByteArray &scores, const QList<int> &itemSizes)
+{
+    if(rev <= savedRev_) return;
+    writeProperty(data, scores);
+    savedRev_ = rev;
+    if(rev != revision()) return;
+    data_ = data;
+    scores_ = scores;
+    itemSizes_.assign(itemSizes.begin(), itemSizes.end());
+    dataValid_ = true;
+    dirty_ = false;
+}
+
+void History::writeProperty(const QByteArray &data, const QByteArray &scores)
+{
+    try
+    {
+        sim::setBufferProperty(sim_handle_app, "customData.simCmd.history", data.toStdString());
+        sim::setBufferProperty(sim_handle_app, "customData.simCmd.historyScores", scores.toStdString());
+    }
+    catch(sim::api_error &ex)
+    {
+        sim::addLog(sim_verbosity_debug, "failed to write history");
+    }
+}
+
+void History::clear()
+{
+    if(log_.isOpen())
+        log_.clear();
+    loaded_ = true;
+    list_->clear();
+    noDups_ = false;
+    data_ = encode(*list_, nullptr, &scores_);
+    itemSizes_.clear();
+    dataValid_ = true;
+    dirty_ = true;
+}
+
+/*!
+ * \brief Append a command to the history
+ * \param change If not null, will be filled with the changes made
+ * \return true if the history has been modified
+ */
+bool History::append(const QString &cmd, const Options &opts, Change *change)
+{
+    ensureLoaded(opts);
+
+    const bool skipRepeated = opts.skipRepeated;
+    const bool removeDups = opts.removeDups;
+    const int maxSize = opts.maxSize;
+
+    Change c;
+
+    if(!removeDups)
+    {
+        noDups_ = false;
+    }
+    else if(!noDups_)
+    {
+        // option has just been enabled: remove duplicates once, from then
+        // on the index is enough to keep the history free of duplicates
+        if(list_->removeDuplicates())
+        {
+            c.dupsRemoved = true;
+            dataValid_ = false;
+        }
+        noDups_ = true;
+    }
+
+    const double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+    if(!skipRepeated || list_->isEmpty() || list_->last() != cmd)
+    {
+        if(removeDups && list_->moveToEnd(cmd))
+        {
+            c.movedToEnd = true;
+            dataValid_ = false;
+        }
+        else
+        {
+            list_->append(cmd);
+            c.appended = true;
+        }
+        list_->addUse(list_->end() - 1, now);
+        if(c.appended)
+            encodeAppend(cmd);
+    }
+    else
+    {
+        // repeated command: not added again, but it is still a use
+        list_->addUse(list_->end() - 1, now);
+        c.rescored = true;
+        encodeLastScore();
+    }
+
+    if(maxSize >= 0 && list_->size() > maxSize)
+    {
+        c.trimmed = list_->size() - maxSize;
+        list_->trimFront(c.trimmed);
+        encodeTrimFront(c.trimmed);
+    }
+
+    if(change) *change = c;
+
+    if(!c.appended && !c.movedToEnd && !c.trimmed && !c.dupsRemoved && !c.rescored)
+        return false;
+
+    list_->compact();
+
+    if(!log_.isOpen())
+        dirty_ = true;
+    else
+        log_.append(cmd, now);
+
+    return true;
+}
+
+void History::ensureLoaded(const Options &opts)
+{
+    if(!loaded_)
+        load(opts);
+}
+
+/*!
+ * \brief Encode the live entries as an indefinite-length CBOR array
+ * \param scores If not null, will be set to the encoded scores
+ * \param rev If not null, will be set to the revision of the list encoded
+ *
+ * Can be called from any thread; the text is copied as UTF-8 straight from
+ * the list arena.
+ */
+QByteArray History::encode(const HistoryList &list, QList<int> *itemSizes, QByteArray *scores, quint64 *rev)
+{
+    QReadLocker locker(list.lock());
+    if(rev) *rev = list.revision();
+    QByteArray data;
+    data.append(cborIndefiniteArray);
+    if(scores)
+    {
+        scores->clear();
+        scores->reserve(list.size() * cborFloatSize + 2);
+        scores->append(cborIndefiniteArray);
+    }
+    for(int i = list.next(-1); i < list.end(); i = list.next(i))
+    {
+        const int oldSize = data.size();
+        appendCborString(data, list.utf8At(i));
+        if(itemSizes)
+            itemSizes->append(data.size() - oldSize);
+        if(scores)
+            appendCborFloat(*scores, list.score(i));
+    }
+    data.append(cborBreak);
+    if(scores)
+        scores->append(cborBreak);
+    return data;
+}
+
+void History::encodeAppend(const QString &cmd)
+{
+    if(!dataValid_) return;
+    const int oldSize = data_.size();
+    data_.chop(1);
+    appendCborString(data_, cmd.toUtf8());
+    itemSizes_.push_back(data_.size() - oldSize + 1);
+    data_.append(cborBreak);
+    scores_.chop(1);
+    appendCborFloat(scores_, list_->score(list_->end() - 1));
+    scores_.append(cborBreak);
+}
+
+void History::encodeTrimFront(int count)
+{
+    if(!dataValid_) return;
+    int numBytes = 0;
+    for(int i = 0; i < count; i++)
+    {
+        numBytes += itemSizes_.front();
+        itemSizes_.pop_front();
+    }
+    data_.remove(1, numBytes);
+    scores_.remove(1, count * cborFloatSize);
+}
+
+void History::encodeLastScore()
+{
+    if(!dataValid_) return;
+    scores_.chop(1 + cborFloatSize);
+    appendCborFloat(scores_, list_->score(list_->end() - 1));
+    scores_.append(cborBreak);
+}
+
+HistoryEncoder::HistoryEncoder(QSharedPointer<HistoryList> list)
+    : list_(list)
+{
+}
+
+void HistoryEncoder::encode()
+{
+    QList<int> itemSizes;
+    QByteArray scores;
+    quint64 rev;
+    QByteArray data = History::encode(*list_, &itemSizes, &scores, &rev);
+    emit encoded(rev, data, scores, itemSizes);
+}
@@ -0,0 +1,105 @@
+#ifndef HISTORY_H_INCLUDED
+#define HISTORY_H_INCLUDED
+
+#include <deque>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QList>
+#include <QSharedPointer>
+#include "HistoryList.h"
+#include "HistoryLog.h"
+
+// Command history, kept in memory by SIM and persisted in the
+// customData.simCmd.history app property, or in a HistoryLog file if
+// customData.simCmd.historyFile is enabled (takes effect at next load).
+//
+// The entries are kept in a HistoryList shared with the UI, see list().
+//
+// The property holds an indefinite-length CBOR array of strings; the
+// encoded form is kept alongside the entries and patched in place, so
+// appending or trimming does not need to re-encode the whole history.
+//
+// The frecency scores (see HistoryList) are persisted the same way, in the
+// customData.simCmd.historyScores app property: a CBOR array of float32,
+// one for each history item; as the items have a fixed size, recording a
+// use only patches the encoded form.
+
+class History
+{
+public:
+    struct Options
+    {
+        bool skipRepeated = true;
+        bool removeDups = false;
+        int maxSize = 1000;
+        bool useFile = false;
+    };
+
+    struct Change
+    {
+        bool appended = false;
+        bool movedToEnd = false;
+        int trimmed = 0;
+        bool dupsRemoved = false;
+        bool rescored = false;
+    };
+
+    History();
+
+    void load(const Options &opts);
+    void save();
+    void write(quint64 rev, const QByteArray &data, const QByteArray &scores, const QList<int> &itemSizes);
+    void clear();
+    bool append(const QString &cmd, const Options &opts, Change *change = nullptr);
+
+    inline QSharedPointer<HistoryList> list() const {return list_;}
+    inline int size() const {return list_->size();}
+    inline quint64 revision() const {return list_->revision();}
+    inline bool isDirty() const {return dirty_;}
+    inline bool isEncoded() const {return dataValid_;}
+
+    static QByteArray encode(const HistoryList &list, QList<int> *itemSizes, QByteArray *scores, quint64 *rev = nullptr);
+
+private:
+    void ensureLoaded(const Options &opts);
+    void loadData(const QByteArray &data, const QByteArray &scores, int maxSize);
+    void writeProperty(const QByteArray &data, const QByteArray &scores);
+    void encodeAppend(const QString &cmd);
+    void encodeTrimFront(int count);
+    void encodeLastScore();
+
+    bool loaded_ = false;
+    QSharedPointer<HistoryList> list_;
+    HistoryLog log_;
+    bool noDups_ = false;
+    QByteArray data_;
+    QByteArray scores_;
+    std::deque<int> itemSizes_;
+    bool dataValid_ = false;
+    quint64 savedRev_ = 0;
+    bool dirty_ = false;
+};
+
+// Encodes history snapshots in a background thread, so that the full
+// re-encode needed after removing duplicates does not run in the SIM thread
+
+class HistoryEncoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    HistoryEncoder(QSharedPointer<HistoryList> list);
+
+public slots:
+    void encode();
+
+signals:
+    void encoded(quint64 rev, QByteArray data, QByteArray scores, QList<int> itemSizes);
+
+private:
+    QSharedPointer<HistoryList> list_;
+};
+
+#endif // HISTORY_H_INCLUDED
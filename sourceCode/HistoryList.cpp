@@ -0,0 +1,654 @@
+#include "HistoryList.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+static const int prefixLengths[] = {32, 16, 8, 4, 2, 1};
+
+static const float noScore = -std::numeric_limits<float>::infinity();
+
+// when the best match can't be taken from the prefix index, only this many
+// of the most recent matches are looked at
+static const int maxRankedScan = 1000;
+
+const double HistoryList::frecencyHalfLife = 7 * 24 * 3600;
+
+static inline quint64 trigram(const QString &s, int i)
+{
+    return (quint64(s[i].unicode()) << 32) | (quint64(s[i + 1].unicode()) << 16) | quint64(s[i + 2].unicode());
+}
+
+static inline uint hashOf(const char *data, int len)
+{
+    return uint(qHash(QByteArray::fromRawData(data, len)));
+}
+
+void HistoryList::setPrefixIndexEnabled(bool enabled)
+{
+    QWriteLocker locker(&lock_);
+    prefixIndexEnabled_ = enabled;
+    reindex();
+}
+
+void HistoryList::setSearchIndexEnabled(bool enabled)
+{
+    QWriteLocker locker(&lock_);
+    searchIndexEnabled_ = enabled;
+    reindex();
+}
+
+void HistoryList::clear()
+{
+    QWriteLocker locker(&lock_);
+    clearUnlocked();
+}
+
+/*!
+ * \brief Replace the content of the list
+ * \param scores The score of each entry, as returned by score(); if empty,
+ * entries are not scored
+ */
+void HistoryList::set(const QStringList &entries, const std::vector<float> &scores)
+{
+    QWriteLocker locker(&lock_);
+    clearUnlocked();
+    entries_.reserve(entries.size());
+    for(int i = 0; i < entries.size(); i++)
+        appendUtf8(entries[i].toUtf8(), i < int(scores.size()) ? scores[i] : noScore);
+}
+
+void HistoryList::append(const QString &cmd)
+{
+    QWriteLocker locker(&lock_);
+    appendUtf8(cmd.toUtf8(), noScore);
+}
+
+/*!
+ * \brief Move the last occurrence of a command to the end
+ * \return false if the command is not in the list
+ */
+bool HistoryList::moveToEnd(const QString &cmd)
+{
+    QWriteLocker locker(&lock_);
+    QByteArray utf8 = cmd.toUtf8();
+    int pos = find(utf8, hashOf(utf8.constData(), utf8.size()));
+    if(pos < 0) return false;
+    const float score = entries_[pos].score;
+    // the entry appended takes over its score (and thus its best ranks)
+    removeAt(pos, false);
+    appendUtf8(utf8, score);
+    return true;
+}
+
+/*!
+ * \brief Remove the oldest entries
+ * \param count Number of entries to remove
+ */
+void HistoryList::trimFront(int count)
+{
+    QWriteLocker locker(&lock_);
+    for(int i = 0; i < count && numLive_ > 0; i++)
+    {
+        while(entries_[head_].removed) head_++;
+        removeAt(head_);
+    }
+}
+
+/*!
+ * \brief Remove all but the last occurrence of each command
+ * \return true if some entry has been removed
+ */
+bool HistoryList::removeDuplicates()
+{
+    QWriteLocker locker(&lock_);
+    bool removed = false;
+    for(int i = head_; i < end(); i++)
+    {
+        Entry &e = entries_[i];
+        if(e.removed) continue;
+        QByteArray utf8 = QByteArray::fromRawData(textData(i), int(e.length));
+        if(find(utf8, hashOf(utf8.constData(), utf8.size())) == i) continue;
+        removeAt(i);
+        removed = true;
+    }
+    return removed;
+}
+
+/*!
+ * \brief Drop removed entries, once they outnumber the live ones
+ * \return true if positions have changed
+ *
+ * This copies the live text to a new arena, and renumbers the positions
+ * stored in the indexes in place (positions keep their order, so the
+ * posting lists stay sorted): no entry is hashed or indexed again. It costs
+ * O(n) nonetheless, but happens at most once every n removals.
+ */
+bool HistoryList::compact()
+{
+    QWriteLocker locker(&lock_);
+    const int numRemoved = end() - numLive_;
+    if(numRemoved <= numLive_ + 64) return false;
+
+    // new position of each entry, or -1 if it is dropped
+    std::vector<int> newPos(entries_.size(), -1);
+    QByteArray arena;
+    arena.reserve(arena_.size());
+    std::vector<Entry> live;
+    live.reserve(numLive_);
+    for(int i = head_; i < end(); i++)
+    {
+        const Entry &e = entries_[i];
+        if(e.removed) continue;
+        newPos[i] = int(live.size());
+        live.push_back({quint32(arena.size()), e.length, false, e.score});
+        arena.append(textData(i), int(e.length));
+    }
+    arena_.swap(arena);
+    entries_.swap(live);
+    head_ = 0;
+    generation_++;
+
+    auto remapList = [&](std::vector<int> &list) {
+        auto out = list.begin();
+        for(int p : list)
+            if(p >= 0 && p < int(newPos.size()) && newPos[p] >= 0)
+                *out++ = newPos[p];
+        list.erase(out, list.end());
+    };
+    for(auto it = index_.begin(); it != index_.end(); ++it)
+        it.value() = newPos[it.value()];
+    for(auto it = prefixIndex_.begin(); it != prefixIndex_.end();)
+    {
+        remapList(it.value());
+        it = it.value().empty() ? prefixIndex_.erase(it) : std::next(it);
+    }
+    for(auto it = prefixBest_.begin(); it != prefixBest_.end();)
+    {
+        int p = newPos[it.value()];
+        if(p < 0)
+        {
+            // the best entry was dropped: take the best remaining one
+            auto bucket = prefixIndex_.constFind(it.key());
+            if(bucket != prefixIndex_.constEnd())
+                for(int q : bucket.value())
+                    if(p == -1 || entries_[q].score >= entries_[p].score)
+                        p = q;
+        }
+        if(p < 0)
+        {
+            it = prefixBest_.erase(it);
+        }
+        else
+        {
+            it.value() = p;
+            ++it;
+        }
+    }
+    for(auto it = searchIndex_.begin(); it != searchIndex_.end();)
+    {
+        remapList(it.value());
+        it = it.value().empty() ? searchIndex_.erase(it) : std::next(it);
+    }
+    return true;
+}
+
+/*!
+ * \brief Record a use of the command at the given position
+ * \param pos Position of the last occurrence of the command
+ * \param time Time of use, in seconds since epoch
+ */
+void HistoryList::addUse(int pos, double time)
+{
+    QWriteLocker locker(&lock_);
+    entries_[pos].score = addScore(entries_[pos].score, time);
+    revision_++;
+    if(prefixIndexEnabled_)
+        updatePrefixBest(pos);
+}
+
+/*!
+ * \brief Add a use at the given time to a score
+ * \param score The score, or -infinity for no score
+ * \param time Time of use, in seconds since epoch
+ */
+float HistoryList::addScore(float score, double time)
+{
+    const double s = time * std::log(2.0) / frecencyHalfLife;
+    if(score == noScore)
+        return float(s);
+    return float(std::max<double>(score, s) + std::log1p(std::exp(-std::abs(score - s))));
+}
+
+QStringList HistoryList::toStringList() const
+{
+    QStringList lst;
+    lst.reserve(numLive_);
+    for(int i = head_; i < end(); i++)
+        if(!entries_[i].removed)
+            lst << at(i);
+    return lst;
+}
+
+QString HistoryList::at(int pos) const
+{
+    return QString::fromUtf8(textData(pos), int(entries_[pos].length));
+}
+
+QByteArray HistoryList::utf8At(int pos) const
+{
+    return QByteArray(textData(pos), int(entries_[pos].length));
+}
+
+/*!
+ * \brief Get the most recent entry
+ *
+ * The last entry is always live, unless the list is empty.
+ */
+QString HistoryList::last() const
+{
+    return at(end() - 1);
+}
+
+/*!
+ * \brief Find the position of the previous live entry
+ * \return the position, or -1 if there is none
+ */
+int HistoryList::prev(int pos) const
+{
+    for(pos = std::min(pos, end()) - 1; pos >= head_; pos--)
+        if(!entries_[pos].removed)
+            return pos;
+    return -1;
+}
+
+/*!
+ * \brief Find the position of the next live entry
+ * \return the position, or end() if there is none
+ */
+int HistoryList::next(int pos) const
+{
+    for(pos = std::max(pos + 1, head_); pos < end(); pos++)
+        if(!entries_[pos].removed)
+            return pos;
+    return end();
+}
+
+/*!
+ * \brief Find the position of the previous live entry starting with prefix
+ * \return the position, or -1 if there is none
+ */
+int HistoryList::prevMatch(int pos, const QString &prefix) const
+{
+    QByteArray utf8 = prefix.toUtf8();
+    const std::vector<int> *bucket = prefixBucket(utf8);
+    if(!bucket)
+    {
+        for(pos = prev(pos); pos >= 0; pos = prev(pos))
+            if(matches(pos, utf8))
+                return pos;
+        return -1;
+    }
+
+    auto it = std::lower_bound(bucket->begin(), bucket->end(), pos);
+    while(it != bucket->begin())
+    {
+        --it;
+        if(*it >= head_ && matches(*it, utf8))
+            return *it;
+    }
+    return -1;
+}
+
+/*!
+ * \brief Find the position of the next live entry starting with prefix
+ * \return the position, or end() if there is none
+ */
+int HistoryList::nextMatch(int pos, const QString &prefix) const
+{
+    QByteArray utf8 = prefix.toUtf8();
+    const std::vector<int> *bucket = prefixBucket(utf8);
+    if(!bucket)
+    {
+        for(pos = next(pos); pos < end(); pos = next(pos))
+            if(matches(pos, utf8))
+                return pos;
+        return end();
+    }
+
+    for(auto it = std::upper_bound(bucket->begin(), bucket->end(), pos); it != bucket->end(); ++it)
+        if(*it >= head_ && matches(*it, utf8))
+            return *it;
+    return end();
+}
+
+/*!
+ * \brief Find the position of the previous live entry containing query
+ * \param pos Position to start searching from (excluded)
+ * \param query The text to search for (case insensitive)
+ * \return the position, or -1 if there is none
+ *
+ * With the trigram index enabled, only the entries containing all the
+ * trigrams of the query are looked at: the posting lists are intersected
+ * backwards from pos, each list skipping ahead (by binary search) to the
+ * candidate proposed by the others.
+ */
+int HistoryList::search(int pos, const QString &query) const
+{
+    const QByteArray folded = query.toLower().toUtf8();
+    bool ascii = true;
+    for(char c : folded)
+        if(uchar(c) >= 0x80) {ascii = false; break;}
+
+    // ASCII queries are compared in place, on the UTF-8 text (non-ASCII
+    // bytes never match them); other ones on the decoded text
+    auto contains = [&](int p) {
+        const Entry &e = entries_[p];
+        if(e.removed) return false;
+        if(!ascii) return at(p).contains(query, Qt::CaseInsensitive);
+        const char *text = textData(p);
+        const int n = int(e.length), m = folded.size();
+        for(int i = 0; i + m <= n; i++)
+        {
+            int j = 0;
+            while(j < m)
+            {
+                char c = text[i + j];
+                if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+                if(c != folded[j]) break;
+                j++;
+            }
+            if(j == m) return true;
+        }
+        return false;
+    };
+
+    std::vector<const std::vector<int> *> lists;
+    if(searchIndexEnabled_ && query.length() >= 3)
+    {
+        QString q = query.toLower();
+        for(int i = 0; i + 3 <= q.length(); i++)
+        {
+            auto it = searchIndex_.find(trigram(q, i));
+            if(it == searchIndex_.end()) return -1;
+            if(std::find(lists.begin(), lists.end(), &it.value()) == lists.end())
+                lists.push_back(&it.value());
+        }
+        std::sort(lists.begin(), lists.end(), [](const std::vector<int> *a, const std::vector<int> *b) {
+            return a->size() < b->size();
+        });
+    }
+
+    if(lists.empty())
+    {
+        for(pos = prev(pos); pos >= 0; pos = prev(pos))
+            if(contains(pos))
+                return pos;
+        return -1;
+    }
+
+    int candidate = std::min(pos, end()) - 1;
+    while(candidate >= head_)
+    {
+        bool agreed = true;
+        for(const std::vector<int> *list : lists)
+        {
+            auto it = std::upper_bound(list->begin(), list->end(), candidate);
+            if(it == list->begin()) return -1;
+            if(*(it - 1) < candidate)
+            {
+                candidate = *(it - 1);
+                agreed = false;
+                break;
+            }
+        }
+        if(!agreed) continue;
+        if(contains(candidate)) return candidate;
+        candidate--;
+    }
+    return -1;
+}
+
+/*!
+ * \brief Find the live entry starting with prefix with the highest score
+ * \return the position, or -1 if there is none
+ *
+ * Only the last occurrence of a command holds its score; the other ones
+ * are unscored, so they can only win (as the most recent match) when no
+ * matching entry is scored.
+ *
+ * With the prefix index, if the best entry of the longest indexed prefix
+ * also starts with the whole prefix, it is the answer. Otherwise only the
+ * most recent matches are looked at.
+ */
+int HistoryList::bestMatch(const QString &prefix) const
+{
+    QByteArray utf8 = prefix.toUtf8();
+    if(prefixIndexEnabled_ && !utf8.isEmpty())
+    {
+        for(int len : prefixLengths)
+        {
+            if(len > utf8.size()) continue;
+            auto it = prefixBest_.find(hashOf(utf8.constData(), len));
+            if(it == prefixBest_.end()) return -1;
+            if(matches(it.value(), utf8)) return it.value();
+            break;
+        }
+    }
+
+    int best = -1, n = 0;
+    for(int pos = prevMatch(end(), prefix); pos >= 0 && n < maxRankedScan; pos = prevMatch(pos, prefix), n++)
+        if(best == -1 || entries_[pos].score > entries_[best].score)
+            best = pos;
+    return best;
+}
+
+/*!
+ * \brief Get the positions of the commands starting with prefix, from the
+ * highest score to the lowest (the most recent first on ties)
+ *
+ * Only the last occurrence of each command is returned.
+ */
+std::vector<int> HistoryList::rankedMatches(const QString &prefix) const
+{
+    std::vector<int> ret;
+    for(int pos = prevMatch(end(), prefix); pos >= 0; pos = prevMatch(pos, prefix))
+        if(find(QByteArray::fromRawData(textData(pos), int(entries_[pos].length)), hashOf(textData(pos), int(entries_[pos].length))) == pos)
+            ret.push_back(pos);
+    std::stable_sort(ret.begin(), ret.end(), [this](int a, int b) {
+        return entries_[a].score > entries_[b].score;
+    });
+    return ret;
+}
+
+/*!
+ * \brief Find the last occurrence of a command
+ * \param utf8 The command, UTF-8 encoded
+ * \param h The hash of the command
+ * \return the position, or -1 if not found
+ */
+int HistoryList::find(const QByteArray &utf8, uint h) const
+{
+    for(auto it = index_.constFind(h); it != index_.constEnd() && it.key() == h; ++it)
+    {
+        int pos = it.value();
+        if(entries_[pos].length == quint32(utf8.size()) && std::memcmp(textData(pos), utf8.constData(), utf8.size()) == 0)
+            return pos;
+    }
+    return -1;
+}
+
+void HistoryList::clearUnlocked()
+{
+    arena_.clear();
+    entries_.clear();
+    head_ = 0;
+    numLive_ = 0;
+    index_.clear();
+    prefixIndex_.clear();
+    prefixBest_.clear();
+    searchIndex_.clear();
+    generation_++;
+    revision_++;
+}
+
+/*!
+ * \brief Append an entry
+ * \param score The score of the command, if it is not in the list yet
+ * (otherwise the score of the previous occurrence is taken over)
+ */
+void HistoryList::appendUtf8(const QByteArray &utf8, float score)
+{
+    const int pos = end();
+    const uint h = hashOf(utf8.constData(), utf8.size());
+    const int old = find(utf8, h);
+    if(old >= 0)
+    {
+        *index_.find(h, old) = pos;
+        if(score == noScore)
+            score = entries_[old].score;
+        entries_[old].score = noScore;
+    }
+    else
+    {
+        index_.insert(h, pos);
+    }
+    entries_.push_back({quint32(arena_.size()), quint32(utf8.size()), false, score});
+    arena_.append(utf8);
+    numLive_++;
+    revision_++;
+    if(prefixIndexEnabled_)
+        indexPrefixes(pos);
+    if(searchIndexEnabled_)
+        indexTrigrams(pos);
+}
+
+/*!
+ * \brief Mark an entry as removed
+ * \param rescanBest Find the new best entry of the prefixes the entry was
+ * the best of (not needed if an entry with the same text and score is
+ * appended right after)
+ */
+void HistoryList::removeAt(int pos, bool rescanBest)
+{
+    Entry &e = entries_[pos];
+    auto it = index_.find(hashOf(textData(pos), int(e.length)), pos);
+    if(it != index_.end())
+        index_.erase(it);
+    e.removed = true;
+    numLive_--;
+    revision_++;
+    if(prefixIndexEnabled_ && rescanBest)
+        rescanPrefixBest(pos);
+}
+
+bool HistoryList::matches(int pos, const QByteArray &prefix) const
+{
+    const Entry &e = entries_[pos];
+    return !e.removed && e.length >= quint32(prefix.size()) && std::memcmp(textData(pos), prefix.constData(), prefix.size()) == 0;
+}
+
+/*!
+ * \brief Get the positions of the entries sharing the longest indexed prefix
+ * \return the sorted positions (possibly of removed or non-matching entries),
+ * or null if the prefix index is disabled or the prefix is empty
+ */
+const std::vector<int> * HistoryList::prefixBucket(const QByteArray &prefix) const
+{
+    static const std::vector<int> empty;
+    if(!prefixIndexEnabled_ || prefix.isEmpty()) return nullptr;
+    for(int len : prefixLengths)
+    {
+        if(len > prefix.size()) continue;
+        auto it = prefixIndex_.find(hashOf(prefix.constData(), len));
+        return it == prefixIndex_.end() ? &empty : &it.value();
+    }
+    return nullptr;
+}
+
+void HistoryList::indexPrefixes(int pos)
+{
+    const Entry &e = entries_[pos];
+    for(int len : prefixLengths)
+    {
+        if(quint32(len) > e.length) continue;
+        std::vector<int> &bucket = prefixIndex_[hashOf(textData(pos), len)];
+        if(bucket.empty() || bucket.back() != pos)
+            bucket.push_back(pos);
+    }
+    updatePrefixBest(pos);
+}
+
+/*!
+ * \brief Make the entry the best of its prefixes, where its score is the
+ * highest (or the same, being more recent)
+ */
+void HistoryList::updatePrefixBest(int pos)
+{
+    const Entry &e = entries_[pos];
+    for(int len : prefixLengths)
+    {
+        if(quint32(len) > e.length) continue;
+        const uint h = hashOf(textData(pos), len);
+        auto it = prefixBest_.find(h);
+        if(it == prefixBest_.end())
+            prefixBest_.insert(h, pos);
+        else if(entries_[it.value()].removed || e.score >= entries_[it.value()].score)
+            it.value() = pos;
+    }
+}
+
+/*!
+ * \brief Find the new best entry of the prefixes of a removed entry, for
+ * those it was the best of
+ *
+ * This scans the prefix's bucket, but only happens when the best entry
+ * itself is removed (e.g. trimmed as the oldest one).
+ */
+void HistoryList::rescanPrefixBest(int pos)
+{
+    const Entry &e = entries_[pos];
+    for(int len : prefixLengths)
+    {
+        if(quint32(len) > e.length) continue;
+        const uint h = hashOf(textData(pos), len);
+        auto it = prefixBest_.find(h);
+        if(it == prefixBest_.end() || it.value() != pos) continue;
+        int best = -1;
+        auto bucket = prefixIndex_.constFind(h);
+        if(bucket != prefixIndex_.constEnd())
+            for(int p : bucket.value())
+                if(p >= head_ && !entries_[p].removed && (best == -1 || entries_[p].score >= entries_[best].score))
+                    best = p;
+        if(best == -1)
+            prefixBest_.erase(it);
+        else
+            it.value() = best;
+    }
+}
+
+void HistoryList::indexTrigrams(int pos)
+{
+    QString text = at(pos).toLower();
+    std::vector<quint64> trigrams;
+    for(int i = 0; i + 3 <= text.length(); i++)
+        trigrams.push_back(trigram(text, i));
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    for(quint64 t : trigrams)
+        searchIndex_[t].push_back(pos);
+}
+
+void HistoryList::reindex()
+{
+    prefixIndex_.clear();
+    prefixBest_.clear();
+    searchIndex_.clear();
+    for(int i = head_; i < end(); i++)
+    {
+        if(entries_[i].removed) continue;
+        if(prefixIndexEnabled_) indexPrefixes(i);
+        if(searchIndexEnabled_) indexTrigrams(i);
+    }
+}
@@ -0,0 +1,120 @@
+#ifndef HISTORYLIST_H_INCLUDED
+#define HISTORYLIST_H_INCLUDED
+
+#include <vector>
+#include <QByteArray>
+#include <QMultiHash>
+#include <QHash>
+#include <QReadWriteLock>
+#include <QString>
+#include <QStringList>
+
+// List of history entries, owned by the SIM side (History) and shared with
+// the UI side (QCommandEdit), which reads it in place.
+//
+// The text of the entries is stored as UTF-8 in a single arena; an entry is
+// just an offset and a length into it.
+//
+// Removed entries are only marked as such, and compacted away on request;
+// a hash index maps each command to its last occurrence, so that moving a
+// repeated command to the end does not scan the list.
+//
+// Entries are addressed by position; positions of live entries stay valid
+// as long as generation() does not change. revision() changes whenever the
+// entries or their scores do.
+//
+// Optionally, a prefix index maps the first 1, 2, 4, ... bytes of each
+// entry to the sorted positions of the entries starting with them, so that
+// prefix searches only look at entries sharing a good part of the prefix.
+//
+// Optionally, a trigram index maps each (lowercase) 3-character substring to
+// the sorted positions of the entries containing it, for substring search.
+//
+// Each command also has a frecency score, kept on its last occurrence: the
+// log of the sum of 2^(t/halfLife) over the times t it has been used, so
+// that a use only updates one score, and scores compare without rescoring.
+// Matching entries can be ranked by that score (most recent first on ties).
+// With the prefix index, the best scored entry of each prefix is kept up to
+// date too, so that the best match is usually found without scanning.
+//
+// Modifying methods take the write lock; other threads must hold the read
+// lock while calling the const methods.
+
+class HistoryList
+{
+public:
+    void setPrefixIndexEnabled(bool enabled);
+    void setSearchIndexEnabled(bool enabled);
+
+    void clear();
+    void set(const QStringList &entries, const std::vector<float> &scores = {});
+    void append(const QString &cmd);
+    bool moveToEnd(const QString &cmd);
+    void trimFront(int count);
+    bool removeDuplicates();
+    bool compact();
+    void addUse(int pos, double time);
+    static float addScore(float score, double time);
+
+    inline QReadWriteLock * lock() const {return &lock_;}
+    inline quint64 generation() const {return generation_;}
+    inline quint64 revision() const {return revision_;}
+
+    QStringList toStringList() const;
+
+    inline int size() const {return numLive_;}
+    inline bool isEmpty() const {return numLive_ == 0;}
+    inline int end() const {return int(entries_.size());}
+    inline bool isValid(int pos) const {return pos >= head_ && pos < end() && !entries_[pos].removed;}
+    QString at(int pos) const;
+    QByteArray utf8At(int pos) const;
+    QString last() const;
+    inline float score(int pos) const {return entries_[pos].score;}
+    int prev(int pos) const;
+    int next(int pos) const;
+    int prevMatch(int pos, const QString &prefix) const;
+    int nextMatch(int pos, const QString &prefix) const;
+    int search(int pos, const QString &query) const;
+    int bestMatch(const QString &prefix) const;
+    std::vector<int> rankedMatches(const QString &prefix) const;
+
+    static const double frecencyHalfLife;
+
+private:
+    struct Entry
+    {
+        quint32 offset;
+        quint32 length;
+        bool removed;
+        float score;
+    };
+
+    inline const char * textData(int pos) const {return arena_.constData() + entries_[pos].offset;}
+    int find(const QByteArray &utf8, uint h) const;
+    void clearUnlocked();
+    void appendUtf8(const QByteArray &utf8, float score);
+    void removeAt(int pos, bool rescanBest = true);
+    bool matches(int pos, const QByteArray &prefix) const;
+    const std::vector<int> * prefixBucket(const QByteArray &prefix) const;
+    void indexPrefixes(int pos);
+    void updatePrefixBest(int pos);
+    void rescanPrefixBest(int pos);
+    void indexTrigrams(int pos);
+    void reindex();
+
+    mutable QReadWriteLock lock_;
+    quint64 generation_ = 0;
+    quint64 revision_ = 0;
+    QByteArray arena_;
+    std::vector<Entry> entries_;
+    int head_ = 0;
+    int numLive_ = 0;
+    QMultiHash<uint, int> index_;
+    bool prefixIndexEnabled_ = false;
+    QHash<uint, std::vector<int>> prefixIndex_;
+    QHash<uint, int> prefixBest_;
+    bool searchIndexEnabled_ = false;
+    QHash<quint64, std::vector<int>> searchIndex_;
+};
+
+#endif // HISTORYLIST_H_INCLUDED
@@ -0,0 +1,145 @@
+#include "HistoryLog.h"
+#include <algorithm>
+#include <limits>
+#include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QtEndian>
+#include <simPlusPlus-2/Lib.h>
+#include "HistoryList.h"
+
+static const quint32 timeFlag = 0x80000000u;
+
+bool HistoryLog::open(const QString &path)
+{
+    close();
+    file_.setFileName(path);
+    if(!file_.open(QIODevice::ReadWrite | QIODevice::Append | QIODevice::Unbuffered))
+    {
+        sim::addLog(sim_verbosity_warnings, "cannot open history file %s: %s", path.toStdString(), file_.errorString().toStdString());
+        return false;
+    }
+    return true;
+}
+
+void HistoryLog::close()
+{
+    if(file_.isOpen())
+        file_.close();
+}
+
+/*!
+ * \brief Read the most recent commands
+ * \param skipRepeated Skip commands equal to the following one
+ * \param removeDups Keep only the most recent occurrence of each command
+ * \param maxSize Maximum number of commands to read (-1 for no limit)
+ * \param scores If not null, filled with the score of each command
+ * returned, from the uses recorded in the part of the file read (on the
+ * last occurrence; other ones are unscored, see HistoryList)
+ * \return the commands, from the oldest to the most recent
+ */
+QStringList HistoryLog::readTail(bool skipRepeated, bool removeDups, int maxSize, std::vector<float> *scores)
+{
+    const float noScore = -std::numeric_limits<float>::infinity();
+    QHash<QString, float> commandScores;
+
+    QStringList result;
+    const qint64 size = file_.size();
+    if(size == 0) return result;
+
+    uchar *data = file_.map(0, size);
+    if(!data)
+    {
+        sim::addLog(sim_verbosity_warnings, "cannot map history file: %s", file_.errorString().toStdString());
+        return result;
+    }
+
+    QSet<QString> seen;
+    qint64 end = size;
+    while(end > 0 && (maxSize < 0 || result.size() < maxSize))
+    {
+        quint32 len = end >= 8 ? qFromLittleEndian<quint32>(data + end - 4) : 0;
+        const bool hasTime = len & timeFlag;
+        len &= ~timeFlag;
+        qint64 start = end - 8 - (hasTime ? 8 : 0) - qint64(len);
+        if(end < 8 || start < 0 || qFromLittleEndian<quint32>(data + start) != len)
+        {
+            sim::addLog(sim_verbosity_warnings, "history file is corrupted at offset %d", end);
+            break;
+        }
+        QString cmd = QString::fromUtf8(reinterpret_cast<const char *>(data + start + 4), int(len));
+        if(hasTime && scores)
+        {
+            const double time = qFromLittleEndian<double>(data + start + 4 + len);
+            auto it = commandScores.find(cmd);
+            if(it == commandScores.end())
+                commandScores.insert(cmd, HistoryList::addScore(noScore, time));
+            else
+                it.value() = HistoryList::addScore(it.value(), time);
+        }
+        end = start;
+
+        if(removeDups)
+        {
+            if(seen.contains(cmd)) continue;
+            seen.insert(cmd);
+        }
+        else if(skipRepeated && !result.isEmpty() && result.last() == cmd)
+        {
+            continue;
+        }
+        result << cmd;
+    }
+
+    file_.unmap(data);
+    std::reverse(result.begin(), result.end());
+
+    if(scores)
+    {
+        scores->assign(result.size(), noScore);
+        QSet<QString> scored;
+        for(int i = result.size() - 1; i >= 0; i--)
+        {
+            if(scored.contains(result[i])) continue;
+            scored.insert(result[i]);
+            (*scores)[i] = commandScores.value(result[i], noScore);
+        }
+    }
+    return result;
+}
+
+/*!
+ * \brief Record a use of a command
+ * \param time Time of use, in seconds since epoch
+ */
+bool HistoryLog::append(const QString &cmd, double time)
+{
+    QByteArray utf8 = cmd.toUtf8();
+    uchar len[4], lenAndFlag[4], t[8];
+    qToLittleEndian<quint32>(quint32(utf8.size()), len);
+    qToLittleEndian<quint32>(quint32(utf8.size()) | timeFlag, lenAndFlag);
+    qToLittleEndian<double>(time, t);
+    QByteArray record;
+    record.reserve(utf8.size() + 16);
+    record.append(reinterpret_cast<const char *>(len), 4);
+    record.append(utf8);
+    record.append(reinterpret_cast<const char *>(t), 8);
+    record.append(reinterpret_cast<const char *>(lenAndFlag), 4);
+    if(file_.write(record) != record.size())
+    {
+        sim::addLog(sim_verbosity_warnings, "failed to write history file: %s", file_.errorString().toStdString());
+        return false;
+    }
+    return true;
+}
+
+bool HistoryLog::clear()
+{
+    return file_.resize(0);
+}
+
+QString HistoryLog::defaultPath()
+{
+    QString dir = QString::fromStdString(sim::getStringParam(sim_stringparam_usersettingsdir));
+    return QDir(dir).filePath("simCmdHistory.log");
+}
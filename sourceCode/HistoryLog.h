@@ -0,0 +1,39 @@
+#ifndef HISTORYLOG_H_INCLUDED
+#define HISTORYLOG_H_INCLUDED
+
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+// Append-only file of every command entered, used as history store when
+// customData.simCmd.historyFile is enabled.
+//
+// Each record is the UTF-8 command, preceded and followed by its length
+// (32 bit, little endian), so that the memory-mapped file can be walked
+// back from its end: loading only looks at the most recent records, and
+// appending is a single write, no matter how long the file is.
+//
+// Every use of a command is recorded (also repeated ones, which are not
+// shown twice), with its time: a double (little endian) before the trailing
+// length, whose highest bit is then set. Frecency scores are computed from
+// those times when loading.
+
+class HistoryLog
+{
+public:
+    bool open(const QString &path);
+    void close();
+    inline bool isOpen() const {return file_.isOpen();}
+
+    QStringList readTail(bool skipRepeated, bool removeDups, int maxSize, std::vector<float> *scores = nullptr);
+    bool append(const QString &cmd, double time);
+    bool clear();
+
+    static QString defaultPath();
+
+private:
+    QFile file_;
+};
+
+#endif // HISTORYLOG_H_INCLUDED
@@ -1,5 +1,6 @@
 #include "SIM.h"
 #include "UI.h"
+#include "FuzzyMatcher.h"
 #include "stubs.h"
 #include <simStack/stackObject.h>
 #include <simStack/stackNull.h>
@@ -16,7 +17,7 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <QRegularExpression>
-#include <QCborArray>
+#include <QCoreApplication>
 #include <simStubsGen/cpp/common.h>
 
 // SIM is a singleton
@@ -26,10 +27,28 @@ SIM *SIM::instance = NULL;
 SIM::SIM(QObject *parent)
     : QObject(parent)
 {
+    qRegisterMetaType< QList<int> >("QList<int>");
+    qRegisterMetaType< QSharedPointer<CompletionReply> >("QSharedPointer<CompletionReply>");
+
+    historySaveTimer = new QTimer(this);
+    historySaveTimer->setSingleShot(true);
+    connect(historySaveTimer, &QTimer::timeout, this, &SIM::flushHistory);
+
+    historyEncoderThread = new QThread();
+    historyEncoder = new HistoryEncoder(history.list());
+    historyEncoder->moveToThread(historyEncoderThread);
+    connect(this, &SIM::encodeHistory, historyEncoder, &HistoryEncoder::encode);
+    connect(historyEncoder, &HistoryEncoder::encoded, this, &SIM::onHistoryEncoded);
+    historyEncoderThread->start(QThread::LowPriority);
 }
 
 SIM::~SIM()
 {
+    historyEncoderThread->quit();
+    historyEncoderThread->wait();
+    delete historyEncoder;
+    delete historyEncoderThread;
+
     SIM::instance = NULL;
 }
 
@@ -68,105 +87,234 @@ void SIM::connectSignals()
     connect(ui, &UI::clearHistory, sim, &SIM::clearHistory);
 }
 
-QStringList loadHistoryData()
+History::Options SIM::historyOptions()
 {
-    QStringList hist;
-    try
-    {
-        auto pdata = sim::getBufferProperty(sim_handle_app, "customData.simCmd.history", {});
-        if(!pdata) return hist;
-        auto pdataBA = QByteArray::fromStdString(*pdata);
-        QCborParserError parserError;
-        QCborValue value = QCborValue::fromCbor(pdataBA, &parserError);
-        if(parserError.error != QCborError::NoError)
-        {
-            sim::addLog(sim_verbosity_warnings, "customData.simCmd.history contains invalid CBOR data: " + parserError.errorString().toStdString());
-            return hist;
-        }
-        if(!value.isArray())
-        {
-            sim::addLog(sim_verbosity_warnings, "customData.simCmd.history is not a CBOR array (type = " + std::to_string(value.type()) + ")");
-            return hist;
-        }
-        QCborArray array = value.toArray();
-        for(const QCborValue &item : array)
-        {
-            if(item.isString())
-                hist.append(item.toString());
-            else
-                sim::addLog(sim_verbosity_warnings, "customData.simCmd.history item is not a CBOR string");
-        }
-    }
-    catch(sim::api_error &ex)
+    History::Options opts;
+    opts.skipRepeated = *sim::getBoolProperty(sim_handle_app, "customData.simCmd.historySkipRepeated", true);
+    opts.removeDups = *sim::getBoolProperty(sim_handle_app, "customData.simCmd.historyRemoveDups", false);
+    opts.maxSize = *sim::getIntProperty(sim_handle_app, "customData.simCmd.historySize", 1000);
+    opts.useFile = *sim::getBoolProperty(sim_handle_app, "customData.simCmd.historyFile", false);
+    return opts;
+}
+
+void SIM::loadHistory()
+{
+    history.load(historyOptions());
+    emit historyChanged();
+}
+
+void SIM::clearHistory()
+{
+    history.clear();
+    flushHistorySync();
+    emit historyChanged();
+}
+
+void SIM::appendHistory(QString cmd)
+{
+    if(!history.append(cmd, historyOptions()))
+        return;
+
+    scheduleHistorySave();
+
+    emit historyChanged();
+}
+
+/*!
+ * \brief Write the history after customData.simCmd.historyWriteDelay ms
+ *
+ * Changes made in the meantime are coalesced into a single write.
+ * A delay of 0 writes immediately (i.e. write-through).
+ */
+void SIM::scheduleHistorySave()
+{
+    int historyWriteDelay = *sim::getIntProperty(sim_handle_app, "customData.simCmd.historyWriteDelay", 1000);
+    if(historyWriteDelay <= 0)
+        flushHistorySync();
+    else if(!historySaveTimer->isActive())
+        historySaveTimer->start(historyWriteDelay);
+}
+
+/*!
+ * \brief Write pending history changes
+ *
+ * If the encoded form of the history is up to date, it is written right away,
+ * otherwise a snapshot is encoded in the background, and written when ready.
+ */
+void SIM::flushHistory()
+{
+    ASSERT_THREAD(!UI);
+
+    historySaveTimer->stop();
+    if(!history.isDirty() || historyEncodePending)
+        return;
+
+    if(history.isEncoded())
     {
-        sim::addLog(sim_verbosity_debug, "failed to read history");
+        history.save();
+        return;
     }
-    return hist;
+
+    historyEncodePending = true;
+    emit encodeHistory();
 }
 
-void saveHistoryData(QStringList hist)
+/*!
+ * \brief Write pending history changes, without deferring to the background
+ */
+void SIM::flushHistorySync()
 {
-    QCborArray array;
-    for(const QString &histItem : hist)
-        array.append(histItem);
-    QByteArray histData = array.toCborValue().toCbor();
-    try
+    historySaveTimer->stop();
+    if(history.isDirty())
+        history.save();
+}
+
+void SIM::onHistoryEncoded(quint64 rev, QByteArray data, QByteArray scores, QList<int> itemSizes)
+{
+    historyEncodePending = false;
+    history.write(rev, data, scores, itemSizes);
+    if(history.isDirty())
+        scheduleHistorySave();
+}
+
+/*!
+ * \brief Forget cached completions, e.g. because scripts have changed
+ */
+void SIM::invalidateCompletionCache()
+{
+    completionCache.clear();
+    callTipCache.clear();
+    resetCompletionSnapshot();
+}
+
+/*!
+ * \brief Forget the API symbols, e.g. because a script has been restarted
+ * \param scriptHandle The script, or -1 for all scripts
+ */
+void SIM::invalidateApiSymbols(int scriptHandle)
+{
+    if(scriptHandle == -1)
     {
-        sim::setBufferProperty(sim_handle_app, "customData.simCmd.history", histData.toStdString());
+        apiSymbolIndex.clear();
     }
-    catch(sim::api_error &ex)
+    else
     {
-        sim::addLog(sim_verbosity_debug, "failed to write history");
+        const QString prefix = QString("%1:").arg(scriptHandle);
+        for(auto it = apiSymbolIndex.begin(); it != apiSymbolIndex.end();)
+        {
+            if(it.key().startsWith(prefix))
+                it = apiSymbolIndex.erase(it);
+            else
+                ++it;
+        }
     }
+    resetCompletionSnapshot();
 }
 
-void SIM::loadHistory()
+/*!
+ * \brief Normalize a language name or suffix (e.g. "Lua", "@lua") to a key
+ */
+QString SIM::langKey(const QString &lang)
 {
-    QStringList hist = loadHistoryData();
-    emit historyChanged(hist);
+    QString key = lang.toLower();
+    if(key.startsWith("@")) key = key.mid(1);
+    return key;
 }
 
-void SIM::clearHistory()
+/*!
+ * \brief Get the key of the API symbols of a script in apiSymbols() and
+ * in the completion snapshot
+ */
+QString SIM::symbolsKey(int scriptHandle, const QString &lang)
 {
-    QStringList hist;
-    saveHistoryData(hist);
-    emit historyChanged(hist);
+    return QString("%1:%2").arg(scriptHandle).arg(langKey(lang));
 }
 
-inline void reverse(QStringList &lst)
+/*!
+ * \brief Enable publishing completion snapshots, for the headless console
+ */
+void SIM::setCompletionSnapshotEnabled(bool enabled)
 {
-    for(size_t i = 0; i < lst.size() / 2; ++i)
-        std::swap(lst[i], lst[lst.size() - i - 1]);
+    completionSnapshotEnabled = enabled;
+    resetCompletionSnapshot();
 }
 
-void SIM::appendHistory(QString cmd)
+/*!
+ * \brief Get the latest completion snapshot
+ *
+ * Can be called from any thread.
+ */
+std::shared_ptr<const CompletionSnapshot> SIM::completionSnapshot() const
+{
+    return std::atomic_load(&completionSnapshot_);
+}
+
+void SIM::publishCompletion(int scriptHandle, const QString &lang, const QString &input, int pos, const QStringList &completions)
 {
-    QStringList hist = loadHistoryData();
+    if(!completionSnapshotEnabled) return;
+    auto snapshot = std::make_shared<CompletionSnapshot>(*completionSnapshot());
+    snapshot->symbols = apiSymbolIndex;
+    if(snapshot->completions.size() >= 256)
+        snapshot->completions.clear();
+    snapshot->completions.insert(CompletionSnapshot::key(scriptHandle, lang, input, pos), completions);
+    std::atomic_store(&completionSnapshot_, std::shared_ptr<const CompletionSnapshot>(snapshot));
+}
 
-    bool historySkipRepeated = *sim::getBoolProperty(sim_handle_app, "customData.simCmd.historySkipRepeated", true);
-    bool historyRemoveDups = *sim::getBoolProperty(sim_handle_app, "customData.simCmd.historyRemoveDups", false);
-    int historySize = *sim::getIntProperty(sim_handle_app, "customData.simCmd.historySize", 1000);
+void SIM::resetCompletionSnapshot()
+{
+    if(!completionSnapshotEnabled) return;
+    auto snapshot = std::make_shared<CompletionSnapshot>();
+    snapshot->symbols = apiSymbolIndex;
+    std::atomic_store(&completionSnapshot_, std::shared_ptr<const CompletionSnapshot>(snapshot));
+}
 
-    if(!historySkipRepeated || hist.isEmpty() || hist[hist.size() - 1] != cmd)
-        hist << cmd;
+/*!
+ * \brief Get the index of the API symbols of a script
+ *
+ * The symbols are fetched on first use (once per script and language, as
+ * plugins are loaded per script, until invalidateApiSymbols() is called).
+ */
+const SymbolIndex & SIM::apiSymbols(int scriptHandle, const QString &lang)
+{
+    const QString key = symbolsKey(scriptHandle, lang);
+    auto it = apiSymbolIndex.find(key);
+    if(it != apiSymbolIndex.end())
+        return it.value();
 
-    if(historyRemoveDups)
+    SymbolIndex &index = apiSymbolIndex[key];
+    try
     {
-        reverse(hist);
-        hist.removeDuplicates();
-        reverse(hist);
+        QStringList symbols;
+        for(const auto &s : sim::getApiFunc(scriptHandle, ""))
+            symbols << QString::fromStdString(s);
+        index.set(symbols);
     }
-
-    if(historySize >= 0)
+    catch(sim::api_error &ex)
     {
-        int numToRemove = hist.size() - historySize;
-        if(numToRemove > 0)
-            hist.erase(hist.begin(), hist.begin() + numToRemove);
+        sim::addLog(sim_verbosity_debug, "failed to read API symbols");
     }
+    return index;
+}
 
-    saveHistoryData(hist);
+/*!
+ * \brief Get the generation for a new completion request
+ *
+ * Can be called from any thread. Requests from a previous generation still
+ * in the queue are dropped without calling the script.
+ */
+quint64 SIM::newCompletionRequest()
+{
+    return ++completionRequest;
+}
 
-    emit historyChanged(hist);
+/*!
+ * \brief Get the generation for a new calltip request
+ *
+ * \sa newCompletionRequest()
+ */
+quint64 SIM::newCallTipRequest()
+{
+    return ++callTipRequest;
 }
 
 void SIM::addLog(int verbosity, QString message)
@@ -186,9 +334,14 @@ void SIM::onExecCode(int scriptHandle, QString lang, QString code)
 
     appendHistory(code);
 
+    // executed code may define or remove globals
+    invalidateCompletionCache();
+
     if(!sim::getIntProperty(sim_handle_app, "headlessMode"))
         sim::addLog(sim_verbosity_msgs|sim_verbosity_undecorated, "> %s", code.toStdString());
 
+    beginInterruptibleExec(scriptHandle, lang);
+
     try
     {
         int stackHandle = sim::createStack();
@@ -206,45 +359,418 @@ void SIM::onExecCode(int scriptHandle, QString lang, QString code)
         sim::addLog(sim_verbosity_errors, "Code evaluation failed.");
     }
 
+    endInterruptibleExec(scriptHandle);
+
     sim::announceSceneContentChange();
 }
 
-void SIM::onAskCompletion(int scriptHandle, QString lang, QString input, int pos, QStringList *clout)
+std::atomic<bool> SIM::interruptRequested{false};
+std::atomic<bool> SIM::interruptHookInstalled{false};
+
+/*!
+ * \brief Ask to interrupt the code being executed
+ * \return false if the code does not run with the interrupt hook (see
+ * beginInterruptibleExec()), in which case nothing is done
+ *
+ * Can be called from any thread, and from a signal handler.
+ */
+bool SIM::requestInterrupt()
 {
-    ASSERT_THREAD(!UI);
+    if(!interruptHookInstalled) return false;
+    interruptRequested = true;
+    return true;
+}
 
-    QStringList cl;
+/*!
+ * \brief Called by the interrupt hook while the code is running
+ * \return true if the code should be interrupted
+ *
+ * Also reports the progress (elapsed time) to the UI.
+ */
+bool SIM::checkInterrupt()
+{
+    if(execTimer.isValid())
+    {
+        qint64 t = execTimer.elapsed();
+        if(t - execProgressTime >= 100)
+        {
+            execProgressTime = t;
+            emit execProgress(t * 0.001);
+        }
+    }
+    return interruptRequested;
+}
+
+/*!
+ * \brief Install the interrupt hook in the script, if enabled by
+ * customData.simCmd.interruptibleExec
+ *
+ * The hook is a Lua count hook, calling simCmd.checkInterrupt every few
+ * thousand instructions, and raising an error when an interrupt has been
+ * requested (e.g. with Ctrl+C). Python scripts are not supported, and
+ * neither are scripts which already have a hook (e.g. a debugger's).
+ *
+ * Calls nest (e.g. the code executed calls simCmd.execBatch): only the
+ * outermost call installs the hook, and each call must be matched by a
+ * call to endInterruptibleExec().
+ */
+void SIM::beginInterruptibleExec(int scriptHandle, const QString &lang)
+{
+    if(execDepth++ > 0) return;
+
+    interruptRequested = false;
+    if(langKey(lang) == "python") return;
+    if(!*sim::getBoolProperty(sim_handle_app, "customData.simCmd.interruptibleExec", false)) return;
+
+    static const std::string hook =
+        "if debug.gethook() then return false end\n"
+        "local simCmd = require 'simCmd'\n"
+        "_simCmdInterruptHook = function()\n"
+        "    if simCmd.checkInterrupt() then error('interrupted', 2) end\n"
+        "end\n"
+        "debug.sethook(_simCmdInterruptHook, '', 5000)\n"
+        "return true@lua";
+    bool installed = false;
     int stackHandle = sim::createStack();
-    writeToStack(input.toStdString(), stackHandle);
-    writeToStack(pos, stackHandle);
     try
     {
-        QString func = "_getCompletion";
-        if(lang != "")
-            func += "@" + lang.toLower();
-        sim::callScriptFunctionEx(scriptHandle, func.toStdString(), stackHandle);
-        std::vector<std::string> r;
-        readFromStack(stackHandle, &r);
+        sim::executeScriptString(scriptHandle, hook, stackHandle);
+        if(sim::getStackSize(stackHandle) > 0)
+        {
+            sim::moveStackItemToTop(stackHandle, 0);
+            if(sim::getStackBoolValue(stackHandle, &installed) != 1)
+                installed = false;
+        }
+    }
+    catch(std::exception &ex)
+    {
+        sim::addLog(sim_verbosity_debug, "failed to install interrupt hook: %s", ex.what());
+    }
+    sim::releaseStack(stackHandle);
+    if(!installed) return;
+
+    interruptHookInstalled = true;
+    execTimer.start();
+    execProgressTime = 0;
+    emit execStarted();
+}
+
+/*!
+ * \brief Remove the interrupt hook, if the matching (outermost)
+ * beginInterruptibleExec() call installed it
+ */
+void SIM::endInterruptibleExec(int scriptHandle)
+{
+    if(--execDepth > 0) return;
+
+    if(interruptHookInstalled)
+    {
+        // only remove our own hook, in case the code replaced it
+        static const std::string unhook =
+            "if debug.gethook() == _simCmdInterruptHook then debug.sethook() end\n"
+            "_simCmdInterruptHook = nil@lua";
+        int stackHandle = sim::createStack();
+        try
+        {
+            sim::executeScriptString(scriptHandle, unhook, stackHandle);
+        }
+        catch(std::exception &ex)
+        {
+            sim::addLog(sim_verbosity_errors, "failed to remove interrupt hook: %s", ex.what());
+        }
+        sim::releaseStack(stackHandle);
 
-        for(const auto &x : r)
-            cl << QString::fromStdString(x);
-        cl.sort();
+        interruptHookInstalled = false;
+        execTimer.invalidate();
+        if(interruptRequested)
+            sim::addLog(sim_verbosity_warnings, "Code execution interrupted.");
+        emit execFinished();
+    }
+    interruptRequested = false;
+}
+
+/*!
+ * \brief Execute several snippets of code, in order, in a single dispatch
+ * \param addToHistory Add the snippets to the command history
+ * \param stopOnError Don't execute the remaining snippets after an error
+ * \param announceChange Announce a scene content change (i.e. make an undo
+ * point) once, after the last snippet
+ * \return the status and the execution time (in seconds) of each snippet
+ * executed; a snippet fails if the exec wrapper raises an error, or
+ * returns false as its first value
+ *
+ * Unlike onExecCode(), snippets are not echoed in the statusbar.
+ */
+QList<SIM::ExecResult> SIM::execBatch(int scriptHandle, const QString &lang, const QStringList &snippets, bool addToHistory, bool stopOnError, bool announceChange)
+{
+    ASSERT_THREAD(!UI);
+
+    QList<ExecResult> results;
+
+    if(addToHistory)
+    {
+        History::Options opts = historyOptions();
+        bool changed = false;
+        for(const QString &code : snippets)
+            if(!code.isEmpty())
+                changed = history.append(code, opts) || changed;
+        if(changed)
+        {
+            scheduleHistorySave();
+            emit historyChanged();
+        }
+    }
+
+    invalidateCompletionCache();
+
+    QString ewFunc = "_evalExec";
+    auto i = execWrapper.find(scriptHandle);
+    if(i != execWrapper.end()) ewFunc = i.value();
+    if(lang != "")
+        ewFunc += "@" + lang.toLower();
+    const std::string func = ewFunc.toStdString();
+
+    beginInterruptibleExec(scriptHandle, lang);
+
+    int stackHandle = sim::createStack();
+    QElapsedTimer timer;
+    for(const QString &code : snippets)
+    {
+        ExecResult r{true, 0};
+        timer.start();
+        try
+        {
+            sim::pushStringOntoStack(stackHandle, code.toStdString());
+            sim::callScriptFunctionEx(scriptHandle, func, stackHandle);
+            r.time = timer.nsecsElapsed() * 1e-9;
+
+            // the exec wrapper reports errors itself (i.e. does not raise
+            // them); like pcall, it returns false first when the code fails
+            if(sim::getStackSize(stackHandle) > 0)
+            {
+                bool status;
+                sim::moveStackItemToTop(stackHandle, 0);
+                if(sim::getStackBoolValue(stackHandle, &status) == 1)
+                    r.ok = status;
+            }
+        }
+        catch(std::exception &ex)
+        {
+            r.time = timer.nsecsElapsed() * 1e-9;
+            r.ok = false;
+        }
+        results << r;
+        sim::popStackItem(stackHandle, 0);
+        if((!r.ok && stopOnError) || interruptRequested) break;
     }
-    catch(std::exception &ex) {}
     sim::releaseStack(stackHandle);
 
-    if(clout)
+    endInterruptibleExec(scriptHandle);
+
+    if(announceChange)
+        sim::announceSceneContentChange();
+
+    return results;
+}
+
+/*!
+ * \brief Compute the completions for the given input
+ * \param generation As returned by newCompletionRequest(), or 0 if the
+ * request cannot be superseded (i.e. the caller waits for the result)
+ */
+void SIM::onAskCompletion(quint64 generation, int scriptHandle, QString lang, QString input, int pos)
+{
+    ASSERT_THREAD(!UI);
+
+    if(generation && generation != completionRequest)
+        return;
+
+    int replace;
+    QStringList cl = computeCompletion(scriptHandle, lang, input, pos, &replace);
+    emit setCompletion(generation, cl, replace);
+}
+
+/*!
+ * \brief Load the API symbols of a language and publish them in the
+ * completion snapshot, for completing and hinting from another thread
+ */
+void SIM::onAskApiSymbols(int scriptHandle, QString lang)
+{
+    ASSERT_THREAD(!UI);
+
+    apiSymbols(scriptHandle, lang);
+    if(!completionSnapshotEnabled) return;
+    auto snapshot = std::make_shared<CompletionSnapshot>(*completionSnapshot());
+    snapshot->symbols = apiSymbolIndex;
+    std::atomic_store(&completionSnapshot_, std::shared_ptr<const CompletionSnapshot>(snapshot));
+}
+
+/*!
+ * \brief Compute the completions for a request made from another thread
+ *
+ * Completions include the input (as wanted by replxx), and are also
+ * published in the completion snapshot.
+ */
+void SIM::onAskCompletionReply(QSharedPointer<CompletionReply> reply, int scriptHandle, QString lang, QString input, int pos)
+{
+    ASSERT_THREAD(!UI);
+
+    int replace;
+    QStringList cl;
+    for(const QString &s : computeCompletion(scriptHandle, lang, input, pos, &replace))
+        cl << (input.left(pos - replace) + s);
+    publishCompletion(scriptHandle, lang, input, pos, cl);
+
+    QMutexLocker locker(&reply->mutex);
+    reply->completions = cl;
+    reply->ready = true;
+    reply->done.wakeAll();
+}
+
+/*!
+ * \brief Compute the completions for the given input, from the API symbols,
+ * from the completion cache, or from the script
+ * \param replace If not null, fuzzy matching is used if enabled, and this
+ * is set to the number of characters before the cursor the completions
+ * replace (otherwise completions are to be inserted at the cursor)
+ * \param masks If not null, filled with the FuzzyMatcher::charMask() of
+ * each completion when they come from the API symbols (left empty otherwise)
+ */
+QStringList SIM::computeCompletion(int scriptHandle, const QString &lang, const QString &input, int pos, int *replace, std::vector<quint32> *masks)
+{
+    if(masks) masks->clear();
+    QStringList cl;
+    const QString context = SymbolIndex::completionContext(input, pos);
+    if(replace) *replace = 0;
+
+    if(replace && *sim::getBoolProperty(sim_handle_app, "customData.simCmd.fuzzyCompletion", false))
     {
-        // clout used by replxx, wants also the context in the completion
-        for(const QString &s : cl)
-            *clout << (input + s);
+        // complete the namespace, and match the member against all its names
+        const QString member = context.mid(context.lastIndexOf('.') + 1);
+        if(!member.isEmpty())
+        {
+            const int start = pos - member.length();
+            std::vector<quint32> memberMasks;
+            QStringList members = computeCompletion(scriptHandle, lang, input.left(start) + input.mid(pos), start, nullptr, &memberMasks);
+            cl = FuzzyMatcher::rank(member, members, memberMasks);
+            *replace = member.length();
+            return cl;
+        }
     }
 
-    emit setCompletion(cl);
+    const SymbolIndex &symbols = apiSymbols(scriptHandle, lang);
+    completionCache.setMaxAge(*sim::getIntProperty(sim_handle_app, "customData.simCmd.completionCacheMaxAge", 5000));
+    if(symbols.coversContext(context))
+    {
+        cl = symbols.complete(context, masks);
+    }
+    else if(!completionCache.lookup(scriptHandle, lang, input, pos, &cl))
+    {
+        int stackHandle = sim::createStack();
+        writeToStack(input.toStdString(), stackHandle);
+        writeToStack(pos, stackHandle);
+        try
+        {
+            QString func = "_getCompletion";
+            if(lang != "")
+                func += "@" + lang.toLower();
+            sim::callScriptFunctionEx(scriptHandle, func.toStdString(), stackHandle);
+            std::vector<std::string> r;
+            readFromStack(stackHandle, &r);
+
+            for(const auto &x : r)
+                cl << QString::fromStdString(x);
+            cl.sort();
+            completionCache.insert(scriptHandle, lang, input, pos, cl);
+        }
+        catch(std::exception &ex) {}
+        sim::releaseStack(stackHandle);
+    }
+    return cl;
 }
 
-void SIM::onAskCallTip(int scriptHandle, QString lang, QString input, int pos)
+/*!
+ * \brief Compute the completions for the given input in the background,
+ * so that they are cached by the time they are asked for
+ *
+ * The completions of a namespace ("foo.") are also used for completing its
+ * members once some characters have been typed (see
+ * CompletionCache::lookup()).
+ *
+ * Can be called from any thread. Only the last prefetch request is kept;
+ * it is served with low priority, after any pending exec or completion
+ * request.
+ */
+void SIM::requestCompletionPrefetch(int scriptHandle, QString lang, QString input, int pos)
 {
+    QMutexLocker locker(&prefetchMutex);
+    const bool posted = prefetch.pending;
+    prefetch.pending = true;
+    prefetch.scriptHandle = scriptHandle;
+    prefetch.lang = lang;
+    prefetch.input = input;
+    prefetch.pos = pos;
+    if(!posted)
+        QCoreApplication::postEvent(this, new QEvent(prefetchEventType()), Qt::LowEventPriority);
+}
+
+/*!
+ * \brief Cancel the pending prefetch request, if any
+ *
+ * Can be called from any thread.
+ */
+void SIM::cancelCompletionPrefetch()
+{
+    QMutexLocker locker(&prefetchMutex);
+    prefetch.pending = false;
+}
+
+bool SIM::event(QEvent *event)
+{
+    if(event->type() != prefetchEventType())
+        return QObject::event(event);
+
+    QMutexLocker locker(&prefetchMutex);
+    if(!prefetch.pending) return true;
+    PrefetchRequest r = prefetch;
+    prefetch.pending = false;
+    locker.unlock();
+
+    computeCompletion(r.scriptHandle, r.lang, r.input, r.pos, nullptr);
+    return true;
+}
+
+QEvent::Type SIM::prefetchEventType()
+{
+    static const QEvent::Type type = QEvent::Type(QEvent::registerEventType());
+    return type;
+}
+
+/*!
+ * \brief Get the calltip for the call at pos
+ * \param callee The function being called, as found by the caller's
+ * CallScanner (empty if unknown)
+ */
+void SIM::onAskCallTip(quint64 generation, int scriptHandle, QString lang, QString input, int pos, QString callee)
+{
+    if(generation && generation != callTipRequest)
+        return;
+
+    // the calltip only depends on the function being called: when that is
+    // a plain name (not e.g. a method call "obj:f("), it is cached until the
+    // scripts may have changed
+    QString key;
+    if(!callee.isEmpty() && !callee.contains(':'))
+    {
+        key = QString("%1:%2:").arg(scriptHandle).arg(langKey(lang)) + callee;
+        auto it = callTipCache.constFind(key);
+        if(it != callTipCache.constEnd())
+        {
+            emit setCallTip(generation, it.value());
+            return;
+        }
+    }
+
     int stackHandle = sim::createStack();
     writeToStack(input.toStdString(), stackHandle);
     writeToStack(pos, stackHandle);
@@ -256,7 +782,14 @@ void SIM::onAskCallTip(int scriptHandle, QString lang, QString input, int pos)
         sim::callScriptFunctionEx(scriptHandle, func.toStdString(), stackHandle);
         std::string r;
         readFromStack(stackHandle, &r);
-        emit setCallTip(QString::fromStdString(r));
+        QString tip = QString::fromStdString(r);
+        if(!key.isEmpty())
+        {
+            if(callTipCache.size() >= 256)
+                callTipCache.clear();
+            callTipCache.insert(key, tip);
+        }
+        emit setCallTip(generation, tip);
     }
     catch(sim::exception &ex) {}
     sim::releaseStack(stackHandle);
@@ -5,8 +5,18 @@
 #include <QObject>
 #include <QString>
 #include <QMap>
+#include <QThread>
+#include <QTimer>
+#include <QMutex>
+#include <QEvent>
+#include <QElapsedTimer>
+#include <atomic>
+#include <memory>
 #include <simPlusPlus-2/Lib.h>
 #include "stubs.h"
+#include "History.h"
+#include "CompletionCache.h"
+#include "SymbolIndex.h"
 
 class SIM : public QObject
 {
@@ -20,11 +30,47 @@ public:
 
     void connectSignals();
 
+    inline QSharedPointer<HistoryList> historyList() const {return history.list();}
+    static History::Options historyOptions();
+
     void loadHistory();
     void appendHistory(QString code);
+    void scheduleHistorySave();
+    void flushHistorySync();
+
+    struct ExecResult
+    {
+        bool ok;
+        double time;
+    };
+    QList<ExecResult> execBatch(int scriptHandle, const QString &lang, const QStringList &snippets, bool addToHistory, bool stopOnError, bool announceChange);
+
+    static bool requestInterrupt();
+    bool checkInterrupt();
+
+    void invalidateCompletionCache();
+    void invalidateApiSymbols(int scriptHandle = -1);
+    static QString langKey(const QString &lang);
+    static QString symbolsKey(int scriptHandle, const QString &lang);
+
+    void setCompletionSnapshotEnabled(bool enabled);
+    std::shared_ptr<const CompletionSnapshot> completionSnapshot() const;
+
+    quint64 newCompletionRequest();
+    quint64 newCallTipRequest();
+
+    void requestCompletionPrefetch(int scriptHandle, QString lang, QString input, int pos);
+    void cancelCompletionPrefetch();
+
+protected:
+    bool event(QEvent *event) override;
 
 public slots:
     void clearHistory();
+    void flushHistory();
+
+private slots:
+    void onHistoryEncoded(quint64 rev, QByteArray data, QByteArray scores, QList<int> itemSizes);
 
 private:
 
@@ -35,23 +81,67 @@ private:
 public slots:
     void addLog(int verbosity, QString message);
     void onExecCode(int scriptHandle, QString lang, QString code);
-    void onAskCompletion(int scriptHandle, QString lang, QString input, int pos, QStringList *clout);
-    void onAskCallTip(int scriptHandle, QString lang, QString input, int pos);
+    void onAskCompletion(quint64 generation, int scriptHandle, QString lang, QString input, int pos);
+    void onAskCompletionReply(QSharedPointer<CompletionReply> reply, int scriptHandle, QString lang, QString input, int pos);
+    void onAskCallTip(quint64 generation, int scriptHandle, QString lang, QString input, int pos, QString callee);
+    void onAskApiSymbols(int scriptHandle, QString lang);
 
 signals:
     void setVisible(bool visible);
     void scriptListChanged(int sandboxScript, int mainScript, QMap<int,QString> simulationScripts, QMap<int,QString> customizationScripts, QMap<int,QString> addons, bool simRunning, bool isRunningJustChanged, bool havePython);
-    void setCompletion(QStringList s);
-    void setCallTip(QString s);
-    void historyChanged(QStringList history);
+    void setCompletion(quint64 generation, QStringList s, int replace);
+    void setCallTip(quint64 generation, QString s);
+    void historyChanged();
     void setPreferredSandboxLang(QString lang);
     void setAutoAcceptCommonCompletionPrefix(bool b);
     void setShowMatchingHistory(bool b);
+    void setRankHistory(bool b);
+    void setCompletionPopup(bool b);
     void setSelectedScript(int scriptHandle, QString lang, bool silent, bool fallbackToSandbox);
     void toggleStatusbarHeight();
+    void encodeHistory();
+    void execStarted();
+    void execProgress(double elapsed);
+    void execFinished();
 
 private:
     QMap<int, QString> execWrapper;
+    History history;
+    QTimer *historySaveTimer;
+    QThread *historyEncoderThread;
+    HistoryEncoder *historyEncoder;
+    bool historyEncodePending = false;
+    const SymbolIndex & apiSymbols(int scriptHandle, const QString &lang);
+    QStringList computeCompletion(int scriptHandle, const QString &lang, const QString &input, int pos, int *replace, std::vector<quint32> *masks = nullptr);
+    static QEvent::Type prefetchEventType();
+    void beginInterruptibleExec(int scriptHandle, const QString &lang);
+    void endInterruptibleExec(int scriptHandle);
+    void publishCompletion(int scriptHandle, const QString &lang, const QString &input, int pos, const QStringList &completions);
+    void resetCompletionSnapshot();
+
+    struct PrefetchRequest
+    {
+        bool pending = false;
+        int scriptHandle;
+        QString lang;
+        QString input;
+        int pos;
+    };
+
+    CompletionCache completionCache;
+    QMap<QString, SymbolIndex> apiSymbolIndex;
+    QHash<QString, QString> callTipCache;
+    bool completionSnapshotEnabled = false;
+    std::shared_ptr<const CompletionSnapshot> completionSnapshot_ = std::make_shared<CompletionSnapshot>();
+    std::atomic<quint64> completionRequest{0};
+    std::atomic<quint64> callTipRequest{0};
+    QMutex prefetchMutex;
+    PrefetchRequest prefetch;
+    static std::atomic<bool> interruptRequested;
+    static std::atomic<bool> interruptHookInstalled;
+    int execDepth = 0;
+    QElapsedTimer execTimer;
+    qint64 execProgressTime = 0;
 };
 
 #endif // UIFUNCTIONS_H_INCLUDED
@@ -0,0 +1,77 @@
+#include "SymbolIndex.h"
+#include "FuzzyMatcher.h"
+#include <algorithm>
+
+void SymbolIndex::set(const QStringList &symbols)
+{
+    symbols_ = symbols;
+    symbols_.sort();
+    symbols_.removeDuplicates();
+
+    namespaces_.clear();
+    masks_.clear();
+    masks_.reserve(symbols_.size());
+    for(const QString &s : symbols_)
+    {
+        int dot = s.lastIndexOf('.');
+        if(dot > 0)
+            namespaces_.insert(s.left(dot));
+        // for fuzzy matching members
+        masks_.push_back(FuzzyMatcher::charMask(s.mid(dot + 1)));
+    }
+}
+
+/*!
+ * \brief Check if the completions for context can be computed by the index
+ * \param context The name being completed, as returned by completionContext()
+ *
+ * That is the case for members of API namespaces (e.g. "sim.getOb"); other
+ * names (globals, locals, members of user tables) are only known by the
+ * script.
+ */
+bool SymbolIndex::coversContext(const QString &context) const
+{
+    int dot = context.lastIndexOf('.');
+    return dot > 0 && namespaces_.contains(context.left(dot));
+}
+
+/*!
+ * \brief Complete a name
+ * \param masks If not null, filled with the FuzzyMatcher::charMask() of the
+ * member name of each symbol completed (i.e. of each suffix, when context
+ * ends with '.')
+ * \return the suffixes completing context to a symbol, sorted
+ */
+QStringList SymbolIndex::complete(const QString &context, std::vector<quint32> *masks) const
+{
+    QStringList ret;
+    if(masks) masks->clear();
+    auto it = std::lower_bound(symbols_.begin(), symbols_.end(), context);
+    for(; it != symbols_.end() && it->startsWith(context); ++it)
+    {
+        // only complete up to the end of the member, not into nested ones
+        if(it->indexOf('.', context.length()) != -1) continue;
+        if(it->length() > context.length())
+        {
+            ret << it->mid(context.length());
+            if(masks) masks->push_back(masks_[it - symbols_.begin()]);
+        }
+    }
+    return ret;
+}
+
+/*!
+ * \brief Get the (possibly dotted) name that ends at the cursor position
+ */
+QString SymbolIndex::completionContext(const QString &input, int pos)
+{
+    pos = std::min(pos, int(input.length()));
+    int start = pos;
+    while(start > 0)
+    {
+        const QChar c = input[start - 1];
+        if(!c.isLetterOrNumber() && c != '_' && c != '.') break;
+        start--;
+    }
+    return input.mid(start, pos - start);
+}
@@ -0,0 +1,30 @@
+#ifndef SYMBOLINDEX_H_INCLUDED
+#define SYMBOLINDEX_H_INCLUDED
+
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+// Sorted list of the API symbols (functions and constants, e.g.
+// "sim.getObject", "simUI.create"), as returned by sim.getApiFunc (which
+// is what apropos searches too), for completing names in static namespaces
+// without calling into the script.
+
+class SymbolIndex
+{
+public:
+    void set(const QStringList &symbols);
+
+    bool coversContext(const QString &context) const;
+    QStringList complete(const QString &context, std::vector<quint32> *masks = nullptr) const;
+
+    static QString completionContext(const QString &input, int pos);
+
+private:
+    QStringList symbols_;
+    QSet<QString> namespaces_;
+    std::vector<quint32> masks_;
+};
+
+#endif // SYMBOLINDEX_H_INCLUDED
@@ -37,9 +37,12 @@ public:
         if(sim::getIntProperty(sim_handle_app, "headlessMode"))
         {
             auto sim = SIM::getInstance();
-            readline = new Readline(sim);
+            readline = new Readline(sim, sim->historyList());
             QObject::connect(readline, &Readline::execCode, sim, &SIM::onExecCode, Qt::BlockingQueuedConnection);
-            QObject::connect(readline, &Readline::askCompletion, sim, &SIM::onAskCompletion, Qt::BlockingQueuedConnection);
+            QObject::connect(readline, &Readline::appendHistory, sim, &SIM::appendHistory, Qt::BlockingQueuedConnection);
+            QObject::connect(readline, &Readline::askCompletion, sim, &SIM::onAskCompletionReply);
+            QObject::connect(readline, &Readline::askApiSymbols, sim, &SIM::onAskApiSymbols);
+            sim->setCompletionSnapshotEnabled(true);
             //readline->start(); // start it on first instance pass, so the prompt is clear
         }
     }
@@ -53,6 +56,7 @@ public:
             QThread::sleep(1);
         }
 
+        SIM::getInstance()->flushHistorySync();
         SIM::destroyInstance();
         SIM_THREAD = NULL;
     }
@@ -79,6 +83,9 @@ public:
         layout->setContentsMargins(0, 0, 0, 0);
         splitterChild->setLayout(layout);
         commanderWidget = new QCommanderWidget();
+        // the list object is created with SIM and never replaced, so it can
+        // be handed to the widget here, in the UI thread
+        commanderWidget->setHistory(SIM::getInstance()->historyList());
         layout->addWidget(statusBar);
         layout->addWidget(commanderWidget);
         splitterChild->setMaximumHeight(600);
@@ -102,15 +109,32 @@ public:
     {
         if(info.event == "objectChanged" && allScripts.contains(info.handle) && data.contains("state"))
         {
+            SIM::getInstance()->invalidateCompletionCache();
+            SIM::getInstance()->invalidateApiSymbols(selectableScript(info.handle));
             updateScriptsList();
         }
     }
 
+    void onSceneSave() override
+    {
+        SIM::getInstance()->flushHistorySync();
+    }
+
     void onScriptStateAboutToBeDestroyed(int scriptHandle, long long scriptUid) override
     {
+        SIM::getInstance()->invalidateCompletionCache();
+        SIM::getInstance()->invalidateApiSymbols(selectableScript(scriptHandle));
         updateScriptsList();
     }
 
+    // the handle a script is selected with (and its API symbols are keyed
+    // by): the script object for detached scripts of scene objects, the
+    // script itself otherwise
+    int selectableScript(int scriptHandle) const
+    {
+        return scriptObjects.value(scriptHandle, scriptHandle);
+    }
+
     void updateUI()
     {
         if(!commanderWidget) return;
@@ -160,6 +184,7 @@ public:
             QString name = QString::fromStdString(sim::getObjectAlias(scriptHandle, 5));
             int detachedScriptHandle = sim::getHandleProperty(scriptHandle, "detachedScript");
             allScripts.insert(detachedScriptHandle, true);
+            scriptObjects.insert(detachedScriptHandle, scriptHandle);
             int state = sim::getIntProperty(detachedScriptHandle, "state");
             if(state != sim_scriptstate_initialized) continue;
             int type = sim::getIntProperty(detachedScriptHandle, "type");
@@ -198,15 +223,36 @@ public:
         sim->setShowMatchingHistory(
             *sim::getBoolProperty(sim_handle_app, "customData.simCmd.showMatchingHistory", false)
         );
+        sim->setRankHistory(
+            *sim::getBoolProperty(sim_handle_app, "customData.simCmd.historyRankByFrecency", false)
+        );
+        sim->setCompletionPopup(
+            *sim::getBoolProperty(sim_handle_app, "customData.simCmd.completionPopup", false)
+        );
     }
 
     void onInstancePass(const sim::InstancePassFlags &flags) override
     {
+        if(flags.objectsErased || flags.modelLoaded || flags.sceneLoaded || flags.undoCalled || flags.redoCalled || flags.sceneSwitched || flags.scriptCreated || flags.scriptErased || flags.simulationStarted || flags.simulationEnded)
+            SIM::getInstance()->invalidateCompletionCache();
+
+        // scripts may have been restarted, or their handles reused
+        if(flags.sceneLoaded || flags.sceneSwitched || flags.scriptErased || flags.simulationStarted || flags.simulationEnded)
+            SIM::getInstance()->invalidateApiSymbols();
+
         if(sim::getIntProperty(sim_handle_app, "headlessMode"))
         {
             // instance pass for headless here
+            History::Options opts = SIM::historyOptions();
+            readline->setOptions(
+                *sim::getBoolProperty(sim_handle_app, "customData.simCmd.historyRankByFrecency", false),
+                *sim::getIntProperty(sim_handle_app, "customData.simCmd.headlessCompletionTimeout", 1000),
+                opts.removeDups,
+                opts.maxSize
+            );
             if(firstInstancePass)
             {
+                SIM::getInstance()->loadHistory();
                 readline->start();
                 firstInstancePass = false;
             }
@@ -230,11 +276,16 @@ public:
             QObject::connect(sim, &SIM::scriptListChanged, commanderWidget, &QCommanderWidget::onScriptListChanged);
             QObject::connect(sim, &SIM::setCompletion, commanderWidget, &QCommanderWidget::onSetCompletion);
             QObject::connect(sim, &SIM::setCallTip, commanderWidget, &QCommanderWidget::onSetCallTip);
-            QObject::connect(sim, &SIM::historyChanged, commanderWidget, &QCommanderWidget::setHistory);
+            QObject::connect(sim, &SIM::historyChanged, commanderWidget, &QCommanderWidget::onHistoryChanged);
             QObject::connect(sim, &SIM::setPreferredSandboxLang, commanderWidget, &QCommanderWidget::setPreferredSandboxLang);
             QObject::connect(sim, &SIM::setAutoAcceptCommonCompletionPrefix, commanderWidget, &QCommanderWidget::setAutoAcceptCommonCompletionPrefix);
             QObject::connect(sim, &SIM::setShowMatchingHistory, commanderWidget, &QCommanderWidget::setShowMatchingHistory);
+            QObject::connect(sim, &SIM::setRankHistory, commanderWidget, &QCommanderWidget::setRankHistory);
+            QObject::connect(sim, &SIM::setCompletionPopup, commanderWidget, &QCommanderWidget::setCompletionPopup);
             QObject::connect(sim, &SIM::setSelectedScript, commanderWidget, &QCommanderWidget::setSelectedScript);
+            QObject::connect(sim, &SIM::execStarted, commanderWidget, &QCommanderWidget::onExecStarted);
+            QObject::connect(sim, &SIM::execProgress, commanderWidget, &QCommanderWidget::onExecProgress);
+            QObject::connect(sim, &SIM::execFinished, commanderWidget, &QCommanderWidget::onExecFinished);
             sim->loadHistory();
         }
 
@@ -281,6 +332,25 @@ public:
         SIM::getInstance()->onExecCode(sandboxScript, lang, code);
     }
 
+    void checkInterrupt(checkInterrupt_in *in, checkInterrupt_out *out)
+    {
+        out->interrupt = SIM::getInstance()->checkInterrupt();
+    }
+
+    void execBatch(execBatch_in *in, execBatch_out *out)
+    {
+        int sandboxScript = sim::getScriptHandleEx(sim_scripttype_sandbox, -1);
+        QString lang = QString::fromStdString(in->lang);
+        QStringList snippets;
+        for(const auto &code : in->snippets)
+            snippets << QString::fromStdString(code);
+        for(const auto &r : SIM::getInstance()->execBatch(sandboxScript, lang, snippets, in->history, in->stopOnError, in->undo))
+        {
+            out->ok.push_back(r.ok);
+            out->time.push_back(r.time);
+        }
+    }
+
 private:
     Readline *readline{nullptr};
     bool firstInstancePass = true;
@@ -290,6 +360,7 @@ private:
     QVBoxLayout *layout = 0L;
     QCommanderWidget *commanderWidget = 0L;
     QMap<int, bool> allScripts;
+    QMap<int, int> scriptObjects;
     bool updateScriptListPending = false;
 };
 
@@ -1,20 +1,39 @@
 #include "qcommandedit.h"
+#include "CompletionPopup.h"
 
 #include <QApplication>
 #include <QTimer>
 #include <QTextLayout>
 #include <QPainter>
 #include <QToolTip>
+#include <QKeyEvent>
+
+#ifdef Q_OS_MACOS
+#define Q_REAL_CTRL Qt::MetaModifier
+#else
+#define Q_REAL_CTRL Qt::ControlModifier
+#endif
 
 QCommandEdit::QCommandEdit(QWidget *parent)
     : QLineEdit(parent),
       showMatchingHistory_(false),
+      rankHistory_(false),
+      useCompletionPopup_(false),
       autoAcceptLongestCommonCompletionPrefix_(true)
 {
+    historyState_.history_.reset(new HistoryList);
+    historyState_.history_->setPrefixIndexEnabled(true);
+    historyState_.history_->setSearchIndexEnabled(true);
+    historyState_.generation_ = 0;
     historyState_.reset();
+    searchState_.reset();
     completionState_.reset();
+    candidatesState_.reset();
     ghostSuffix_.clear();
 
+    completionPopup_ = new CompletionPopup(this);
+    connect(completionPopup_, &CompletionPopup::activated, this, &QCommandEdit::acceptPopupCompletion);
+
     connect(this, &QCommandEdit::returnPressed, this, &QCommandEdit::onReturnPressed);
     connect(this, &QCommandEdit::escapePressed, this, &QCommandEdit::onEscapePressed);
     connect(this, &QCommandEdit::upPressed, this, &QCommandEdit::onUpPressed);
@@ -35,6 +54,26 @@ void QCommandEdit::setShowMatchingHistory(bool show)
         searchMatchingHistoryAndShowGhost();
 }
 
+/*!
+ * \brief Rank history entries matching the current text by frecency,
+ * instead of by recency (affects the matching entry shown and UP)
+ */
+void QCommandEdit::setRankHistory(bool rank)
+{
+    rankHistory_ = rank;
+}
+
+/*!
+ * \brief Show multiple completions in a popup list, instead of cycling
+ * through them with TAB
+ */
+void QCommandEdit::setCompletionPopupEnabled(bool enabled)
+{
+    useCompletionPopup_ = enabled;
+    if(!enabled)
+        completionPopup_->hide();
+}
+
 void QCommandEdit::setAutoAcceptLongestCommonCompletionPrefix(bool accept)
 {
     autoAcceptLongestCommonCompletionPrefix_ = accept;
@@ -44,6 +83,16 @@ void QCommandEdit::paintEvent(QPaintEvent *event)
 {
     QLineEdit::paintEvent(event);
 
+    if(searchState_.active_)
+    {
+        // show search prompt on the right side
+        QString prompt = QString("%1reverse-i-search: %2").arg(searchState_.failing_ ? "failing " : "", searchState_.query_);
+        QPainter p(this);
+        p.setPen(QPen(Qt::gray, 1));
+        p.drawText(rect().adjusted(0, 0, -4, 0), Qt::AlignRight | Qt::AlignVCenter, prompt);
+        return;
+    }
+
     /* show ghost suffix. only shown if:
      * - widget has focus
      * - cursor is at end
@@ -72,6 +121,72 @@ void QCommandEdit::paintEvent(QPaintEvent *event)
 
 void QCommandEdit::keyPressEvent(QKeyEvent *event)
 {
+    const bool ctrlR = event->key() == Qt::Key_R && event->modifiers().testFlag(Q_REAL_CTRL);
+    if(searchState_.active_)
+    {
+        if(ctrlR)
+        {
+            searchHistory(true);
+            return;
+        }
+        if(event->key() == Qt::Key_Escape)
+        {
+            endHistorySearch(false);
+            return;
+        }
+        if(event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter)
+        {
+            endHistorySearch(true);
+            return;
+        }
+        if(event->key() == Qt::Key_Backspace)
+        {
+            searchState_.query_.chop(1);
+            searchHistory(false);
+            return;
+        }
+        if(!event->text().isEmpty() && event->text()[0].isPrint())
+        {
+            searchState_.query_ += event->text();
+            searchHistory(false);
+            return;
+        }
+        // any other key accepts the search result, and is processed normally
+        endHistorySearch(true);
+    }
+    else if(ctrlR)
+    {
+        beginHistorySearch();
+        return;
+    }
+    if(completionPopup_->isVisible())
+    {
+        switch(event->key())
+        {
+        case Qt::Key_Return:
+        case Qt::Key_Enter:
+            acceptPopupCompletion(completionPopup_->currentRow());
+            return;
+        case Qt::Key_Escape:
+            completionPopup_->hide();
+            completionState_.reset();
+            return;
+        case Qt::Key_PageUp:
+            completionPopup_->moveSelection(-10);
+            return;
+        case Qt::Key_PageDown:
+            completionPopup_->moveSelection(10);
+            return;
+        case Qt::Key_Up:
+        case Qt::Key_Down:
+            break;
+        default:
+            // any other key goes to the editor, and dismisses the list
+            completionPopup_->hide();
+            completionState_.reset();
+            break;
+        }
+    }
     if(event->key() == Qt::Key_Escape)
     {
         Q_EMIT escapePressed();
@@ -87,14 +202,30 @@ void QCommandEdit::keyPressEvent(QKeyEvent *event)
         Q_EMIT downPressed();
         return;
     }
+    if(!completionState_.replaced_.isEmpty() && hasSelectedText())
+    {
+        // the proposed completion replaces what has been typed: put that
+        // back rather than overwriting or deleting the completion
+        if(event->key() == Qt::Key_Backspace || event->key() == Qt::Key_Delete)
+        {
+            cancelCompletion();
+            return;
+        }
+        if(!event->text().isEmpty() && event->text()[0].isPrint())
+            cancelCompletion();
+    }
     QLineEdit::keyPressEvent(event);
 }
 
 bool QCommandEdit::eventFilter(QObject *obj, QEvent *event)
 {
+    if(event->type() == QEvent::FocusOut)
+        completionPopup_->hide();
     if(event->type() == QEvent::KeyPress)
     {
         QKeyEvent *keyEvent = static_cast<QKeyEvent*>(event);
+        if(searchState_.active_ && (keyEvent->key() == Qt::Key_Tab || keyEvent->key() == Qt::Key_Backtab))
+            endHistorySearch(true);
         if(keyEvent->key() == Qt::Key_Tab)
         {
             Q_EMIT tabPressed();
@@ -118,19 +249,31 @@ void QCommandEdit::clear()
     ghostSuffix_ = "";
     historyState_.reset();
     completionState_.reset();
+    candidatesState_.reset();
+    completionPopup_->hide();
     setToolTipAtCursor("");
 }
 
 /*!
- * \brief Replacew the history content
- * \param history The new history content
+ * \brief Set the history to navigate and search
+ * \param history The history list, possibly shared with another thread
  */
-void QCommandEdit::setHistory(const QStringList &history)
+void QCommandEdit::setHistory(QSharedPointer<HistoryList> history)
 {
     if(historyState_.index_ != -1)
         clear();
     historyState_.history_ = history;
     historyState_.reset();
+    searchState_.index_ = -1;
+}
+
+/*!
+ * \brief Notify that the content of the history has changed
+ */
+void QCommandEdit::onHistoryChanged()
+{
+    if(!searchState_.active_ && cursorPosition() == text().length())
+        searchMatchingHistoryAndShowGhost();
 }
 
 /*!
@@ -141,53 +284,93 @@ void QCommandEdit::navigateHistory(int delta)
 {
     if(delta == 0) return;
 
-    // clip delta to +1/-1:
-    delta = (delta < -1 ? -1 : delta > 1 ? 1 : delta);
+    const HistoryList &history = *historyState_.history_;
+    int newIndex;
+    int rank = -1;
+    bool atEnd;
+    QString entry;
+    {
+        QReadLocker locker(history.lock());
+        validateHistoryPositions();
 
-    // compute actual index (-1 => last):
-    int newIndex = historyState_.index_;
-    if(newIndex == -1) newIndex = historyState_.history_.length();
+        // not navigating => nothing comes after
+        if(delta > 0 && historyState_.index_ == -1) return;
 
-    if(historyState_.prefixFilter_.isEmpty())
-    {
-        // simply navigate up/down
-        setHistoryIndex(newIndex + delta);
-        return;
-    }
+        // compute actual index (-1 => last):
+        newIndex = historyState_.index_;
+        if(newIndex == -1) newIndex = history.end();
 
-    // search matching history
-    while(1)
-    {
-        newIndex += delta;
-        if(newIndex < 0 || newIndex >= historyState_.history_.length())
-            break;
-        if(historyState_.history_[newIndex].startsWith(historyState_.prefixFilter_))
+        if(historyState_.prefixFilter_.isEmpty())
+            newIndex = delta < 0 ? history.prev(newIndex) : history.next(newIndex);
+        else if(rankHistory_)
         {
-            setHistoryIndex(newIndex);
-            return;
+            // the ranking is computed once, when navigation begins
+            if(historyState_.index_ == -1)
+            {
+                historyState_.ranked_ = history.rankedMatches(historyState_.prefixFilter_);
+                historyState_.rank_ = -1;
+            }
+            rank = historyState_.rank_ - delta;
+            if(rank >= int(historyState_.ranked_.size())) return;
+            newIndex = rank < 0 ? history.end() : historyState_.ranked_[rank];
         }
+        else if(delta < 0)
+            newIndex = history.prevMatch(newIndex, historyState_.prefixFilter_);
+        else
+            newIndex = history.nextMatch(newIndex, historyState_.prefixFilter_);
+
+        if(newIndex < 0) return;
+        atEnd = newIndex >= history.end();
+        if(!atEnd) entry = history.at(newIndex);
     }
-    if(newIndex >= historyState_.history_.length())
+
+    if(atEnd && !historyState_.prefixFilter_.isEmpty())
     {
         // reached history end => go back at the orginal edit state
         QString savedFilter = historyState_.prefixFilter_;
-        setHistoryIndex(newIndex);
+        showHistoryEntry(-1, "");
         historyState_.prefixFilter_ = savedFilter;
     }
+    else
+    {
+        showHistoryEntry(atEnd ? -1 : newIndex, entry);
+        if(!atEnd) historyState_.rank_ = rank;
+    }
 }
 
 /*!
  * \brief Select an entry from command history and write it in the editor
- * \param index Index of the history entry
+ * \param index Position of the history entry
  */
 void QCommandEdit::setHistoryIndex(int index)
 {
-    if(index < 0 || index > historyState_.history_.length())
-        return;
+    QString entry;
+    {
+        const HistoryList &history = *historyState_.history_;
+        QReadLocker locker(history.lock());
+        if(index < 0 || index > history.end())
+            return;
+        if(index == history.end())
+            index = -1;
+        else if(history.isValid(index))
+            entry = history.at(index);
+        else
+            return;
+        historyState_.generation_ = history.generation();
+    }
+    showHistoryEntry(index, entry);
+}
 
+/*!
+ * \brief Write a history entry in the editor
+ * \param index Position of the history entry, or -1 to go past the last entry
+ * \param entry The text of the history entry
+ */
+void QCommandEdit::showHistoryEntry(int index, const QString &entry)
+{
     ghostSuffix_ = "";
 
-    if(index >= historyState_.history_.length())
+    if(index == -1)
     {
         // going past last item resets the editor to whatever text
         // has been entered before beginning history navigation
@@ -198,13 +381,47 @@ void QCommandEdit::setHistoryIndex(int index)
     else
     {
         historyState_.index_ = index;
-        setText(historyState_.history_[index]);
+        setText(entry);
     }
 
     QTimer::singleShot(0, this, &QCommandEdit::moveCursorToEnd);
     setToolTipAtCursor("");
 }
 
+/*!
+ * \brief Start a reverse incremental search thru command history
+ *
+ * While searching, typed text is searched in the history entries,
+ * Ctrl+R goes to the previous match, Enter accepts it and Esc cancels.
+ */
+void QCommandEdit::beginHistorySearch()
+{
+    searchState_.reset();
+    searchState_.active_ = true;
+    searchState_.savedText_ = text();
+    ghostSuffix_ = "";
+    update();
+}
+
+/*!
+ * \brief End the reverse incremental search
+ * \param accept If true, keep the matched entry, otherwise restore the text
+ * entered before beginning the search
+ */
+void QCommandEdit::endHistorySearch(bool accept)
+{
+    if(!searchState_.active_) return;
+
+    QString savedText = searchState_.savedText_;
+    searchState_.reset();
+    historyState_.reset();
+    if(!accept)
+        setText(savedText);
+    deselect();
+    moveCursorToEnd();
+    update();
+}
+
 static QString longestCommonPrefix(const QStringList &strs)
 {
     QString result;
@@ -254,11 +471,44 @@ void QCommandEdit::insertTextAtCursor(const QString &txt, bool selected)
 /*!
  * \brief Set the list of completions for the current cursor position
  * \param completion The list of completions
+ * \param replace Number of characters before the cursor the completions
+ * replace (e.g. with fuzzy matching), or 0 if they are to be inserted
  */
-void QCommandEdit::setCompletion(const QStringList &completion)
+void QCommandEdit::setCompletion(const QStringList &completion, int replace)
 {
+    // text or cursor have changed since the completion was requested
+    if(!completionState_.requested_) return;
+
     completionState_.completion_ = completion;
 
+    if(replace > 0)
+    {
+        // select the text being replaced, so that the first completion
+        // shown takes its place; it is restored if completion is cancelled
+        candidatesState_.reset();
+        if(completion.isEmpty()) return;
+        const int c = cursorPosition();
+        completionState_.replaced_ = text().mid(c - replace, replace);
+        if(useCompletionPopup_ && completion.size() > 1)
+        {
+            showCompletionPopup();
+            return;
+        }
+        bool oldBlockSignals = blockSignals(true);
+        setSelection(c - replace, replace);
+        blockSignals(oldBlockSignals);
+        navigateCompletion(1);
+        return;
+    }
+
+    if(!candidatesState_.narrowing_)
+    {
+        candidatesState_.prefix_ = text().left(cursorPosition());
+        candidatesState_.suffix_ = text().mid(cursorPosition());
+        candidatesState_.candidates_ = completion;
+        candidatesState_.valid_ = true;
+    }
+
     if(autoAcceptLongestCommonCompletionPrefix_)
     {
         QString lcp = longestCommonPrefix(completion);
@@ -282,10 +532,53 @@ void QCommandEdit::setCompletion(const QStringList &completion)
         }
     }
 
-    if(completionState_.requested_)
+    if(useCompletionPopup_ && completionState_.completion_.size() > 1)
+        showCompletionPopup();
+    else if(completionState_.requested_)
         navigateCompletion(1);
 }
 
+/*!
+ * \brief Show the current completions in the popup list
+ *
+ * Unlike cycling through completions, browsing the list does not change
+ * the text until a completion is accepted.
+ */
+void QCommandEdit::showCompletionPopup()
+{
+    // show the part of the name already typed before each completion
+    QString prefix;
+    if(completionState_.replaced_.isEmpty())
+    {
+        const QString before = text().left(cursorPosition());
+        int start = before.length();
+        while(start > 0 && (before[start - 1].isLetterOrNumber() || before[start - 1] == '_'))
+            start--;
+        prefix = before.mid(start);
+    }
+    completionPopup_->showCompletions(completionState_.completion_, prefix, mapToGlobal(cursorRect().bottomLeft()));
+}
+
+/*!
+ * \brief Insert the completion selected in the popup list
+ * \param row Index of the completion
+ */
+void QCommandEdit::acceptPopupCompletion(int row)
+{
+    completionPopup_->hide();
+    if(row < 0 || row >= completionState_.completion_.size())
+        return;
+
+    const QString completion = completionState_.completion_[row];
+    const QString replaced = completionState_.replaced_;
+    completionState_.reset();
+    if(!replaced.isEmpty())
+        setSelection(cursorPosition() - replaced.length(), replaced.length());
+    insertTextAtCursor(completion, false);
+    completionState_.reset();
+    searchMatchingHistoryAndShowGhost();
+}
+
 /*!
  * \brief Reset the completion state
  */
@@ -294,6 +587,15 @@ void QCommandEdit::resetCompletion()
     completionState_.reset();
 }
 
+/*!
+ * \brief Forget the last list of completions received, so that the next
+ * completion is requested (e.g. because the target script has changed)
+ */
+void QCommandEdit::resetCompletionCandidates()
+{
+    candidatesState_.reset();
+}
+
 /*!
  * \brief Set a proposed completion by inserting a selected text at the cursor
  * \param s the completion text to insert
@@ -344,6 +646,7 @@ void QCommandEdit::acceptCompletion()
     if(hasSelectedText())
     {
         QString currentCompletion = selectedText();
+        completionState_.replaced_.clear();
         cancelCompletion();
         int c = cursorPosition();
         QString t = text();
@@ -362,6 +665,12 @@ void QCommandEdit::cancelCompletion()
     if(hasSelectedText())
     {
         setCurrentCompletion("");
+        if(!completionState_.replaced_.isEmpty())
+        {
+            bool oldBlockSignals = blockSignals(true);
+            insertTextAtCursor(completionState_.replaced_, false);
+            blockSignals(oldBlockSignals);
+        }
         completionState_.reset();
     }
 }
@@ -428,29 +737,79 @@ void QCommandEdit::onEscapePressed()
 
 void QCommandEdit::onUpPressed()
 {
+    if(completionPopup_->isVisible())
+    {
+        completionPopup_->moveSelection(-1);
+        return;
+    }
     navigateHistory(-1);
 }
 
 void QCommandEdit::onDownPressed()
 {
+    if(completionPopup_->isVisible())
+    {
+        completionPopup_->moveSelection(1);
+        return;
+    }
     navigateHistory(1);
 }
 
 void QCommandEdit::onTabPressed()
 {
+    if(completionPopup_->isVisible())
+    {
+        completionPopup_->moveSelection(1);
+        return;
+    }
     if(completionState_.completion_.isEmpty())
     {
         if(completionState_.requested_)
             return;
         completionState_.requested_ = true;
-        Q_EMIT askCompletion(text(), cursorPosition());
+        if(!narrowCompletion())
+            Q_EMIT askCompletion(text(), cursorPosition());
         return;
     }
     navigateCompletion(1);
 }
 
+/*!
+ * \brief Compute the completions from the last list received, if the text
+ * has only been extended with identifier characters since it was requested
+ * \return false if a new list has to be requested
+ */
+bool QCommandEdit::narrowCompletion()
+{
+    if(!candidatesState_.valid_) return false;
+
+    const QString before = text().left(cursorPosition());
+    if(text().mid(cursorPosition()) != candidatesState_.suffix_ || !before.startsWith(candidatesState_.prefix_))
+        return false;
+
+    const QString extra = before.mid(candidatesState_.prefix_.length());
+    for(const QChar &c : extra)
+        if(!c.isLetterOrNumber() && c != '_')
+            return false;
+
+    QStringList narrowed;
+    for(const QString &s : candidatesState_.candidates_)
+        if(s.length() > extra.length() && s.startsWith(extra))
+            narrowed << s.mid(extra.length());
+
+    candidatesState_.narrowing_ = true;
+    setCompletion(narrowed);
+    candidatesState_.narrowing_ = false;
+    return true;
+}
+
 void QCommandEdit::onShiftTabPressed()
 {
+    if(completionPopup_->isVisible())
+    {
+        completionPopup_->moveSelection(-1);
+        return;
+    }
     navigateCompletion(-1);
 }
 
@@ -475,25 +834,73 @@ void QCommandEdit::onTextEdited()
         searchMatchingHistoryAndShowGhost();
 }
 
+/*!
+ * \brief Drop the positions held by the navigation and search states, if
+ * the history has been compacted in the meantime
+ *
+ * Must be called with the history read lock held.
+ */
+void QCommandEdit::validateHistoryPositions()
+{
+    const HistoryList &history = *historyState_.history_;
+    if(historyState_.generation_ == history.generation()) return;
+    historyState_.generation_ = history.generation();
+    historyState_.index_ = -1;
+    searchState_.index_ = -1;
+}
+
+void QCommandEdit::searchHistory(bool older)
+{
+    const HistoryList &history = *historyState_.history_;
+    QString &query = searchState_.query_;
+
+    int i = -1;
+    QString entry;
+    if(!query.isEmpty())
+    {
+        QReadLocker locker(history.lock());
+        validateHistoryPositions();
+        int from = history.end();
+        if(older && searchState_.index_ != -1)
+            from = searchState_.index_;
+        i = history.search(from, query);
+        if(i >= 0) entry = history.at(i);
+    }
+    searchState_.failing_ = !query.isEmpty() && i < 0;
+    if(i >= 0)
+    {
+        searchState_.index_ = i;
+        setText(entry);
+        setSelection(entry.indexOf(query, 0, Qt::CaseInsensitive), query.length());
+    }
+    else if(!older)
+    {
+        searchState_.index_ = -1;
+        if(query.isEmpty())
+            setText(searchState_.savedText_);
+    }
+    update();
+}
+
 void QCommandEdit::searchMatchingHistoryAndShowGhost()
 {
     if(!text().isEmpty() && showMatchingHistory_)
     {
-        for(int i = historyState_.history_.length() - 1; i >= 0; --i)
+        const HistoryList &history = *historyState_.history_;
+        QReadLocker locker(history.lock());
+        int i = rankHistory_ ? history.bestMatch(text()) : history.prevMatch(history.end(), text());
+        if(i >= 0)
         {
-            if(historyState_.history_[i].startsWith(text()))
-            {
-                ghostSuffix_ = historyState_.history_[i].mid(text().length());
-                repaint();
-                return;
-            }
+            ghostSuffix_ = history.at(i).mid(text().length());
+            update();
+            return;
         }
     }
 
     if(!ghostSuffix_.isEmpty())
     {
         ghostSuffix_ = "";
-        repaint();
+        update();
     }
 }
 
@@ -501,11 +908,32 @@ void QCommandEdit::HistoryState::reset()
 {
     index_ = -1;
     prefixFilter_ = "";
+    ranked_.clear();
+    rank_ = -1;
+}
+
+void QCommandEdit::SearchState::reset()
+{
+    active_ = false;
+    query_ = "";
+    index_ = -1;
+    failing_ = false;
+    savedText_ = "";
+}
+
+void QCommandEdit::CandidatesState::reset()
+{
+    valid_ = false;
+    narrowing_ = false;
+    prefix_ = "";
+    suffix_ = "";
+    candidates_.clear();
 }
 
 void QCommandEdit::CompletionState::reset()
 {
     completion_.clear();
+    replaced_.clear();
     requested_ = false;
     index_ = -1;
 }
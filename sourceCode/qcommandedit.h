@@ -3,6 +3,10 @@
 
 #include <QLineEdit>
 #include <QStringList>
+#include <QSharedPointer>
+#include "HistoryList.h"
+
+class CompletionPopup;
 
 class QCommandEdit : public QLineEdit
 {
@@ -11,7 +15,10 @@ public:
     explicit QCommandEdit(QWidget *parent = nullptr);
 
     void setShowMatchingHistory(bool show);
+    void setRankHistory(bool rank);
+    void setCompletionPopupEnabled(bool enabled);
     void setAutoAcceptLongestCommonCompletionPrefix(bool accept);
+    inline bool isSearchingHistory() const {return searchState_.active_;}
 
     void paintEvent(QPaintEvent *event);
     void keyPressEvent(QKeyEvent *event);
@@ -19,12 +26,16 @@ public:
 
 public Q_SLOTS:
     void clear();
-    void setHistory(const QStringList &history);
+    void setHistory(QSharedPointer<HistoryList> history);
+    void onHistoryChanged();
     void navigateHistory(int delta);
     void setHistoryIndex(int index);
+    void beginHistorySearch();
+    void endHistorySearch(bool accept);
     void insertTextAtCursor(const QString &txt, bool selected);
-    void setCompletion(const QStringList &completion);
+    void setCompletion(const QStringList &completion, int replace = 0);
     void resetCompletion();
+    void resetCompletionCandidates();
     void setCurrentCompletion(const QString &s);
     void navigateCompletion(int delta);
     void acceptCompletion();
@@ -53,29 +64,67 @@ private Q_SLOTS:
     void onSelectionChanged();
     void onCursorPositionChanged(int old, int now);
     void onTextEdited();
+    void acceptPopupCompletion(int row);
 
 private:
     struct HistoryState
     {
-        QStringList history_;
+        QSharedPointer<HistoryList> history_;
+        quint64 generation_;
         int index_;
         QString prefixFilter_;
+        std::vector<int> ranked_;
+        int rank_;
 
         void reset();
     } historyState_;
 
+    struct SearchState
+    {
+        bool active_;
+        QString query_;
+        int index_;
+        bool failing_;
+        QString savedText_;
+
+        void reset();
+    } searchState_;
+
     struct CompletionState
     {
         QStringList completion_;
+        QString replaced_;
         bool requested_;
         int index_;
 
         void reset();
     } completionState_;
 
+    // last list of completions received, and the text around the cursor it
+    // was requested for, to complete locally as long as the text is only
+    // extended with identifier characters
+    struct CandidatesState
+    {
+        bool valid_;
+        bool narrowing_;
+        QString prefix_;
+        QString suffix_;
+        QStringList candidates_;
+
+        void reset();
+    } candidatesState_;
+
+    void showHistoryEntry(int index, const QString &entry);
+    void validateHistoryPositions();
+    void searchHistory(bool older);
     void searchMatchingHistoryAndShowGhost();
+    bool narrowCompletion();
+    void showCompletionPopup();
 
     bool showMatchingHistory_;
+    bool rankHistory_;
+    bool useCompletionPopup_;
+    CompletionPopup *completionPopup_;
     bool autoAcceptLongestCommonCompletionPrefix_;
     QString ghostSuffix_; // for showing matching history
 };
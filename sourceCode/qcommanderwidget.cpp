@@ -72,30 +72,47 @@ void QCommanderEdit::keyPressEvent(QKeyEvent *event)
 {
     auto w = static_cast<QCommanderWidget*>(parent());
 
+    if(isSearchingHistory())
+    {
+        QCommandEdit::keyPressEvent(event);
+        return;
+    }
+
     if(event->key() == Qt::Key_ParenLeft)
     {
         acceptCompletion();
 
         emit askCallTip(text(), cursorPosition());
     }
-    else if(event->key() == Qt::Key_Period)
+    else if(event->key() == Qt::Key_Period || event->key() == Qt::Key_Colon)
     {
         acceptCompletion();
+
+        // the member list will likely be asked for next: compute it in the
+        // meantime, once the key has been processed
+        QCommandEdit::keyPressEvent(event);
+        emit prefetchCompletion(text(), cursorPosition());
+        return;
     }
     else if(event->key() == Qt::Key_Comma)
     {
         // reshow last tooltip when comma is pressed
-        w->onSetCallTip(toolTip());
+        w->setCallTip(toolTip());
     }
     else if(event->key() == Qt::Key_ParenRight)
     {
-        w->onSetCallTip("");
+        w->setCallTip("");
     }
     else if(event->key() == Qt::Key_L && event->modifiers().testFlag(Q_REAL_CTRL))
     {
         emit clearConsole();
         return;
     }
+    else if(event->key() == Qt::Key_C && event->modifiers().testFlag(Q_REAL_CTRL) && !hasSelectedText() && w->isExecRunning())
+    {
+        SIM::requestInterrupt();
+        return;
+    }
     QCommandEdit::keyPressEvent(event);
 }
 
@@ -132,14 +149,21 @@ QCommanderWidget::QCommanderWidget(QWidget *parent)
     grid->addWidget(editor, 1, 0);
     grid->addWidget(scriptCombo, 1, 1);
 
+    callTipTimer = new QTimer(this);
+    callTipTimer->setSingleShot(true);
+    callTipTimer->setInterval(0);
+    connect(callTipTimer, &QTimer::timeout, this, &QCommanderWidget::sendCallTipRequest);
+
     connect(editor, &QCommanderEdit::askCompletion, this, &QCommanderWidget::onAskCompletion);
     connect(editor, &QCommanderEdit::askCallTip, this, &QCommanderWidget::onAskCallTip);
+    connect(editor, &QCommanderEdit::prefetchCompletion, this, &QCommanderWidget::onPrefetchCompletion);
     connect(editor, &QCommanderEdit::execute, this, &QCommanderWidget::onExecute);
     connect(editor, &QCommanderEdit::escape, this, &QCommanderWidget::onEscape);
     connect(editor, &QCommanderEdit::editorCleared, this, &QCommanderWidget::onEditorCleared);
     connect(editor, &QCommanderEdit::textChanged, this, &QCommanderWidget::onEditorChanged);
     connect(editor, &QCommanderEdit::cursorPositionChanged, this, &QCommanderWidget::onEditorCursorChanged);
     connect(editor, &QCommanderEdit::clearConsole, this, &QCommanderWidget::onClearConsole);
+    connect(scriptCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), editor, &QCommanderEdit::resetCompletionCandidates);
     connect(SIM::getInstance(), &SIM::toggleStatusbarHeight, this, &QCommanderWidget::toggleStatusbarHeight);
 }
 
@@ -169,17 +193,84 @@ void QCommanderWidget::onAskCompletion(const QString &cmd, int cursorPos)
     QString lang;
     getSelectedScriptInfo(scriptType, scriptHandle, lang);
     if(scriptHandle != -1)
-        emit askCompletion(scriptHandle, lang, cmd, cursorPos, nullptr);
+    {
+        completionRequest = SIM::getInstance()->newCompletionRequest();
+        emit askCompletion(completionRequest, scriptHandle, lang, cmd, cursorPos);
+    }
 }
 
+void QCommanderWidget::onPrefetchCompletion(const QString &cmd, int cursorPos)
+{
+    int scriptType;
+    int scriptHandle;
+    QString lang;
+    getSelectedScriptInfo(scriptType, scriptHandle, lang);
+    if(scriptHandle == -1) return;
+    // in Python, ':' is not member access
+    if(lang.toLower() == "python" && cursorPos > 0 && cmd[cursorPos - 1] == ':') return;
+    prefetchInput = cmd.left(cursorPos);
+    SIM::getInstance()->requestCompletionPrefetch(scriptHandle, lang, cmd, cursorPos);
+}
+
+/*!
+ * \brief Ask for the calltip at the given position
+ *
+ * Requests are coalesced: only the last one made before control returns
+ * to the event loop is sent (see sendCallTipRequest()).
+ */
 void QCommanderWidget::onAskCallTip(QString input, int pos)
+{
+    callTipInput = input;
+    callTipPos = pos;
+    if(!callTipTimer->isActive())
+        callTipTimer->start();
+}
+
+/*!
+ * \brief Send the pending calltip request to SIM, if the cursor is inside
+ * a call, and the call is not the same as the one of the last request
+ */
+void QCommanderWidget::sendCallTipRequest()
 {
     int scriptType;
     int scriptHandle;
     QString lang;
     getSelectedScriptInfo(scriptType, scriptHandle, lang);
-    if(scriptHandle != -1)
-        emit askCallTip(scriptHandle, lang, input, pos);
+    if(scriptHandle == -1) return;
+
+    callScanner.setLanguage(lang.toLower() == "python" ? CallScanner::Python : CallScanner::Lua);
+    CallScanner::Call call;
+    if(!callScanner.enclosingCall(callTipInput, callTipPos, &call))
+    {
+        // not inside a call: no calltip (also drop the pending reply)
+        if(!callTipContext.isEmpty())
+        {
+            callTipContext = "";
+            callTipRequest = SIM::getInstance()->newCallTipRequest();
+            setCallTip("");
+        }
+        return;
+    }
+
+    // the calltip is determined by the text up to the open parenthesis of
+    // the call; within the same call, only the highlighted argument changes
+    QString context = QString("%1:%2:").arg(scriptHandle).arg(lang) + callTipInput.left(call.openPos + 1);
+    if(context == callTipContext)
+    {
+        if(call.argIndex != callTipArg)
+        {
+            callTipArg = call.argIndex;
+            if(!callTipText.isEmpty())
+                setCallTip(CallScanner::highlightArgument(callTipText, callTipArg));
+        }
+        return;
+    }
+    callTipContext = context;
+    callTipText = "";
+    callTipArg = call.argIndex;
+
+    callTipRequest = SIM::getInstance()->newCallTipRequest();
+    emit askCallTip(callTipRequest, scriptHandle, lang, callTipInput, callTipPos, call.callee);
 }
 
 void QCommanderWidget::onExecute(const QString &cmd)
@@ -208,7 +299,8 @@ void QCommanderWidget::onExecute(const QString &cmd)
     }
 
     editor->clear();
-    onSetCallTip("");
+    setCallTip("");
+    callTipContext = "";
 }
 
 void QCommanderWidget::onEscape()
@@ -218,11 +310,23 @@ void QCommanderWidget::onEscape()
 
 void QCommanderWidget::onEditorCleared()
 {
-    onSetCallTip("");
+    setCallTip("");
+    callTipContext = "";
 }
 
 void QCommanderWidget::onEditorChanged(QString text)
 {
+    // the prefetched members are still useful while typing one of them
+    // (see CompletionCache::lookup())
+    const QString before = text.left(editor->cursorPosition());
+    bool typingMember = !prefetchInput.isEmpty() && before.startsWith(prefetchInput);
+    for(int i = prefetchInput.length(); typingMember && i < before.length(); i++)
+        typingMember = before[i].isLetterOrNumber() || before[i] == '_';
+    if(!typingMember)
+    {
+        prefetchInput.clear();
+        SIM::getInstance()->cancelCompletionPrefetch();
+    }
     onAskCallTip(text, editor->cursorPosition());
 }
 
@@ -261,12 +365,42 @@ void QCommanderWidget::toggleStatusbarHeight()
         expandStatusbar();
 }
 
-void QCommanderWidget::onSetCompletion(const QStringList &comp)
+void QCommanderWidget::onSetCompletion(quint64 generation, const QStringList &comp, int replace)
+{
+    // a newer request has been made in the meantime
+    if(generation != completionRequest) return;
+
+    editor->setCompletion(comp, replace);
+}
+
+void QCommanderWidget::onSetCallTip(quint64 generation, const QString &tip)
+{
+    if(generation != callTipRequest) return;
+
+    callTipText = tip;
+    setCallTip(CallScanner::highlightArgument(tip, callTipArg));
+}
+
+void QCommanderWidget::onExecStarted()
 {
-    editor->setCompletion(comp);
+    execRunning = true;
+    placeholderText = editor->placeholderText();
 }
 
-void QCommanderWidget::onSetCallTip(const QString &tip)
+void QCommanderWidget::onExecProgress(double elapsed)
+{
+    if(!execRunning) return;
+    editor->setPlaceholderText(QString("Running (%1 s), press Ctrl+C to interrupt...").arg(elapsed, 0, 'f', 1));
+}
+
+void QCommanderWidget::onExecFinished()
+{
+    if(!execRunning) return;
+    execRunning = false;
+    editor->setPlaceholderText(placeholderText);
+}
+
+void QCommanderWidget::setCallTip(const QString &tip)
 {
 #ifdef CUSTOM_TOOLTIP_WINDOW
     if(tip.isEmpty())
@@ -363,9 +497,14 @@ void QCommanderWidget::onScriptListChanged(int sandboxScript_, int mainScript, Q
     setSelectedScript(oldScriptHandle, oldLang, true, isRunningJustChanged);
 }
 
-void QCommanderWidget::setHistory(QStringList hist)
+void QCommanderWidget::setHistory(QSharedPointer<HistoryList> history)
 {
-    editor->setHistory(hist);
+    editor->setHistory(history);
+}
+
+void QCommanderWidget::onHistoryChanged()
+{
+    editor->onHistoryChanged();
 }
 
 void QCommanderWidget::setPreferredSandboxLang(const QString &lang)
@@ -383,6 +522,16 @@ void QCommanderWidget::setShowMatchingHistory(bool b)
     editor->setShowMatchingHistory(b);
 }
 
+void QCommanderWidget::setRankHistory(bool b)
+{
+    editor->setRankHistory(b);
+}
+
+void QCommanderWidget::setCompletionPopup(bool b)
+{
+    editor->setCompletionPopupEnabled(b);
+}
+
 void QCommanderWidget::setSelectedScript(int newScriptHandle, QString newLang, bool silent, bool fallbackToSandbox)
 {
     newLang = newLang.left(1).toUpper() + newLang.mid(1).toLower();
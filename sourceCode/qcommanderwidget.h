@@ -10,7 +10,9 @@
 #include <QComboBox>
 #include <QPushButton>
 #include <QLabel>
+#include <QTimer>
 #include "qcommandedit.h"
+#include "CallScanner.h"
 
 class QCommanderWidget;
 class QCommanderEdit;
@@ -43,6 +45,7 @@ public:
 signals:
     void clearConsole();
     void askCallTip(QString input, int pos);
+    void prefetchCompletion(const QString &cmd, int cursorPos);
 
 public slots:
 
@@ -68,10 +71,13 @@ protected:
 public:
     void getSelectedScriptInfo(int &type, int &handle, QString &lang);
     bool statusbarExpanded();
+    inline bool isExecRunning() const {return execRunning;}
 
 private slots:
     void onAskCompletion(const QString &cmd, int cursorPos);
     void onAskCallTip(QString input, int pos);
+    void sendCallTipRequest();
+    void onPrefetchCompletion(const QString &cmd, int cursorPos);
     void onExecute(const QString &cmd);
     void onEscape();
     void onEditorCleared();
@@ -83,24 +89,43 @@ private slots:
     void toggleStatusbarHeight();
 
 public slots:
-    void onSetCompletion(const QStringList &comp);
-    void onSetCallTip(const QString &tip);
+    void onSetCompletion(quint64 generation, const QStringList &comp, int replace);
+    void onSetCallTip(quint64 generation, const QString &tip);
+    void setCallTip(const QString &tip);
     void onScriptListChanged(int sandboxScript, int mainScript, QMap<int,QString> simulationScripts, QMap<int,QString> customizationScripts, QMap<int,QString> addons, bool simRunning, bool isRunningJustChanged, bool havePython);
-    void setHistory(QStringList history);
+    void setHistory(QSharedPointer<HistoryList> history);
+    void onHistoryChanged();
     void setPreferredSandboxLang(const QString &lang);
     void setAutoAcceptCommonCompletionPrefix(bool b);
     void setShowMatchingHistory(bool b);
+    void setRankHistory(bool b);
+    void setCompletionPopup(bool b);
     void setSelectedScript(int scriptHandle, QString lang, bool silent, bool fallbackToSandbox);
+    void onExecStarted();
+    void onExecProgress(double elapsed);
+    void onExecFinished();
 
 signals:
-    void askCompletion(int scriptHandle, QString langSuffix, QString input, int pos, QStringList *clout);
-    void askCallTip(int scriptHandle, QString langSuffix, QString input, int pos);
+    void askCompletion(quint64 generation, int scriptHandle, QString langSuffix, QString input, int pos);
+    void askCallTip(quint64 generation, int scriptHandle, QString langSuffix, QString input, int pos, QString callee);
     void execCode(int scriptHandle, QString langSuffix, QString code);
     void addLog(int verbosity, QString message);
 
 private:
     QString preferredSandboxLang;
     int sandboxScript = -1;
+    quint64 completionRequest = 0;
+    quint64 callTipRequest = 0;
+    QTimer *callTipTimer;
+    QString callTipInput;
+    int callTipPos = 0;
+    QString callTipContext;
+    QString callTipText;
+    int callTipArg = -1;
+    CallScanner callScanner;
+    QString prefetchInput;
+    bool execRunning = false;
+    QString placeholderText;
     bool havePython = false;
 
     QList<int> statusbarSize;